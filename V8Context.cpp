@@ -2,6 +2,9 @@
 
 #include <pthread.h>
 #include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <sstream>
 
@@ -12,12 +15,19 @@
 
 #define L(...) fprintf(stderr, ##__VA_ARGS__)
 
+#define MB (1024 * 1024)
+
+// Scripts are terminated once the live heap passes this share of the old
+// space limit, leaving V8 room to unwind them.
+#define HEAP_LIMIT_PERCENT 90
+
 using namespace v8;
 using namespace std;
 
 int V8Context::number = 0;
 
-void set_perl_error(const TryCatch& try_catch) {
+static string
+error_message(const TryCatch& try_catch) {
     Handle<Message> msg = try_catch.Message();
 
     char message[1024];
@@ -31,7 +41,11 @@ void set_perl_error(const TryCatch& try_catch) {
         !msg.IsEmpty() ? msg->GetStartColumn(): 0
     );
 
-    sv_setpv(ERRSV, message);
+    return message;
+}
+
+void set_perl_error(const TryCatch& try_catch) {
+    sv_setpv(ERRSV, error_message(try_catch).c_str());
     sv_utf8_upgrade(ERRSV);
 }
 
@@ -52,36 +66,124 @@ check_perl_error() {
     return Handle<Value>();
 }
 
-// Internally-used wrapper around coderefs
-static IV
-calculate_size(SV *sv) {
-    return 1000;
-    /*
-     * There are horrible bugs in the current Devel::Size, so we can't do this
-     * accurately. But if there weren't, this is how we'd do it!
-    dSP;
-    ENTER;
-    SAVETMPS;
+// Bytes a Perl value keeps alive, reported to V8 so that wrappers of large
+// data get collected. Containers are sampled and followed a few levels
+// deep only, so the estimate costs about the same for any amount of data.
+#define SIZE_SAMPLE 32
+#define SIZE_DEPTH 4
+#define SIZE_MAX_REPORTED (1 << 30)
 
-    PUSHMARK(SP);
-    XPUSHs(sv);
-    PUTBACK;
-    int returned = call_pv("Devel::Size::total_size", G_SCALAR);
-    if (returned != 1) {
-        warn("Error calculating sv size");
+static size_t
+sv_size(pTHX_ SV *sv, int depth) {
+    if (!sv)
         return 0;
+
+    size_t size = sizeof(SV);
+
+    if (SvROK(sv))
+        return depth ? size + sv_size(aTHX_ SvRV(sv), depth - 1) : size;
+
+    switch (SvTYPE(sv)) {
+    case SVt_PVAV: {
+        AV *av = (AV*)sv;
+        size += sizeof(XPVAV) + (AvMAX(av) + 1) * sizeof(SV*);
+
+        SSize_t count = AvFILLp(av) + 1;
+        if (!depth || !count || SvRMAGICAL(av) || !AvARRAY(av))
+            break;
+
+        SSize_t step = count > SIZE_SAMPLE ? count / SIZE_SAMPLE : 1;
+        size_t sampled = 0, sample_size = 0;
+        for (SSize_t i = 0; i < count; i += step, sampled++)
+            sample_size += sv_size(aTHX_ AvARRAY(av)[i], depth - 1);
+
+        size += sample_size / sampled * count;
+        break;
     }
+    case SVt_PVHV: {
+        HV *hv = (HV*)sv;
+        size += sizeof(XPVHV) + (HvMAX(hv) + 1) * sizeof(HE*);
+
+        size_t count = HvTOTALKEYS(hv);
+        if (!depth || !count || SvRMAGICAL(hv) || !HvARRAY(hv))
+            break;
+
+        // Walk whole buckets spread over the table until enough entries
+        // are seen, visiting a bounded number of buckets even when most
+        // are empty
+        size_t buckets = HvMAX(hv) + 1;
+        size_t step = buckets > SIZE_SAMPLE ? buckets / SIZE_SAMPLE : 1;
+        size_t sampled = 0, sample_size = 0;
+        for (size_t i = 0; i < buckets && sampled < SIZE_SAMPLE; i += step) {
+            for (HE *he = HvARRAY(hv)[i]; he && sampled < SIZE_SAMPLE; he = HeNEXT(he), sampled++) {
+                sample_size += sizeof(HE) + sizeof(HEK) + HeKLEN(he)
+                             + sv_size(aTHX_ HeVAL(he), depth - 1);
+            }
+        }
 
-    SPAGAIN;
-    IV size    = SvIV(POPs);
-    PUTBACK;
-    FREETMPS;
-    LEAVE;
+        // Sparse tables may show no entries at all
+        size += sampled ? sample_size / sampled * count : (sizeof(HE) + sizeof(HEK) + sizeof(SV)) * count;
+        break;
+    }
+    default:
+        if (SvTYPE(sv) >= SVt_PV && SvPOKp(sv))
+            size += SvLEN(sv);
+        break;
+    }
 
     return size;
-    */
 }
 
+static IV
+calculate_size(SV *sv) {
+    size_t size = sv_size(aTHX_ sv, SIZE_DEPTH);
+    return size > SIZE_MAX_REPORTED ? SIZE_MAX_REPORTED : size;
+}
+
+// Strings shorter than this are cheaper to copy than to share
+#define EXTERNAL_STRING_MIN_LENGTH 4096
+
+static bool
+is_ascii(const char *str, STRLEN len) {
+    for (STRLEN i = 0; i < len; i++)
+        if ((unsigned char)str[i] >= 0x80)
+            return false;
+    return true;
+}
+
+#ifndef SV_DO_COW_SVSETSV
+#define SV_DO_COW_SVSETSV 0
+#endif
+
+// Exposes the buffer of a Perl string to V8 without copying it. We hold our
+// own SV, which shares the buffer with the original on copy-on-write perls,
+// so later changes to the original can't pull the buffer away from V8. Get
+// magic has run already when the string was checked.
+class SvExternalString : public String::ExternalAsciiStringResource {
+public:
+    SvExternalString(SV *sv_)
+        : sv(newSV(0))
+    {
+        sv_setsv_flags(sv, sv_, SV_DO_COW_SVSETSV);
+        V8::AdjustAmountOfExternalAllocatedMemory(SvCUR(sv));
+    }
+
+    virtual ~SvExternalString() {
+        V8::AdjustAmountOfExternalAllocatedMemory(-(int)SvCUR(sv));
+        SvREFCNT_dec(sv);
+    }
+
+    virtual const char* data() const {
+        return SvPVX(sv);
+    }
+
+    virtual size_t length() const {
+        return SvCUR(sv);
+    }
+
+    SV *sv;
+};
+
 #define SETUP_PERL_CALL(PUSHSELF) \
     int len = args.Length(); \
 \
@@ -90,13 +192,13 @@ calculate_size(SV *sv) {
     SAVETMPS; \
 \
     PUSHMARK(SP); \
+    EXTEND(SP, len + 1); \
 \
     PUSHSELF; \
 \
-    for (int i = 1; i < len; i++) { \
-        SV *arg = context->v82sv(args[i]); \
-        mXPUSHs(arg); \
-    } \
+    for (int i = 0; i < len; i++) \
+        mPUSHs(context->v82sv(args[i])); \
+\
     PUTBACK;
 
 #define CONVERT_PERL_RESULT() \
@@ -117,29 +219,139 @@ calculate_size(SV *sv) {
 \
     return v;
 
-void SvMap::add(Handle<Object> object, long ptr) {
-    objects.insert(
-        pair<int, SimpleObjectData*>(
-            object->GetIdentityHash(),
-            new SimpleObjectData(object, ptr)
-        )
-    );
+void SvMap::add(Handle<Object> object, SV* sv) {
+    int identity = object->GetIdentityHash();
+    SvMapSlot& slot = insert(identity);
+    slot.identity = identity;
+    slot.index = used - 1;
+    slot.sv = sv;
+    objects->Set(slot.index, object);
 }
 
 SV* SvMap::find(Handle<Object> object) {
-    int hash = object->GetIdentityHash();
+    if (!used)
+        return NULL;
+
+    int identity = object->GetIdentityHash();
+
+    for (size_t i = identity & mask(); !(*slots)[i].empty(); i = (i + 1) & mask()) {
+        SvMapSlot& slot = (*slots)[i];
+        if (slot.identity == identity && objects->Get(slot.index)->StrictEquals(object))
+            return newRV_inc(slot.sv);
+    }
+
+    return NULL;
+}
+
+void PrototypeMap::add(HV* stash, PerlPrototype* prototype) {
+    PrototypeSlot& slot = insert(pointer_hash(stash));
+    slot.stash = stash;
+    slot.prototype = prototype;
+}
+
+PerlPrototype* PrototypeMap::find(HV* stash) {
+    if (!used)
+        return NULL;
 
-    for (sv_map::const_iterator it = objects.find(hash); it != objects.end(), it->first == hash; it++)
-        if (it->second->object->Equals(object))
-            return newRV_inc(INT2PTR(SV*, it->second->ptr));
+    for (size_t i = pointer_hash(stash) & mask(); !(*slots)[i].empty(); i = (i + 1) & mask()) {
+        if ((*slots)[i].stash == stash)
+            return (*slots)[i].prototype;
+    }
 
     return NULL;
 }
 
+void HandleMap::add(SV* sv, Handle<Value> value) {
+    HandleMapSlot& slot = insert(pointer_hash(sv));
+    slot.sv = sv;
+    slot.value = value;
+}
+
+Handle<Value> HandleMap::find(SV* sv) {
+    if (!used)
+        return Handle<Value>();
+
+    for (size_t i = pointer_hash(sv) & mask(); !(*slots)[i].empty(); i = (i + 1) & mask()) {
+        if ((*slots)[i].sv == sv)
+            return (*slots)[i].value;
+    }
+
+    return Handle<Value>();
+}
+
+// FNV-1a, good enough to spread script sources over the cache index
+static size_t
+hash_bytes(const char* data, size_t len, size_t hash = 2166136261u) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static size_t
+script_hash(const string& source, const string& origin) {
+    return hash_bytes(origin.data(), origin.size(), hash_bytes(source.data(), source.size()));
+}
+
+Handle<Script> ScriptCache::find(const string& source, const string& origin) {
+    size_t hash = script_hash(source, origin);
+
+    pair<entry_index::iterator, entry_index::iterator> range = index.equal_range(hash);
+    for (entry_index::iterator it = range.first; it != range.second; it++) {
+        ScriptCacheEntry* entry = *it->second;
+        if (entry->source == source && entry->origin == origin) {
+            // move to the front of the LRU list
+            entries.splice(entries.begin(), entries, it->second);
+            hits++;
+            return Local<Script>::New(entry->script);
+        }
+    }
+
+    misses++;
+    return Handle<Script>();
+}
+
+void ScriptCache::add(const string& source, const string& origin, Handle<Script> script) {
+    if (!capacity_)
+        return;
+
+    while (entries.size() >= capacity_)
+        evict();
+
+    size_t hash = script_hash(source, origin);
+    entries.push_front(new ScriptCacheEntry(hash, source, origin, script));
+    index.insert(pair<size_t, entry_list::iterator>(hash, entries.begin()));
+}
+
+void ScriptCache::evict() {
+    entry_list::iterator last = --entries.end();
+    ScriptCacheEntry* entry = *last;
+
+    pair<entry_index::iterator, entry_index::iterator> range = index.equal_range(entry->hash);
+    for (entry_index::iterator it = range.first; it != range.second; it++) {
+        if (it->second == last) {
+            index.erase(it);
+            break;
+        }
+    }
+
+    entries.erase(last);
+    delete entry;
+}
+
+void ScriptCache::clear() {
+    for (entry_list::iterator it = entries.begin(); it != entries.end(); it++)
+        delete *it;
+    entries.clear();
+    index.clear();
+}
+
 ObjectData::ObjectData(V8Context* context_, Handle<Object> object_, SV* sv_)
     : context(context_)
     , object(Persistent<Object>::New(object_))
     , sv(sv_)
+    , ptr(0)
 {
     if (!sv) return;
 
@@ -149,19 +361,25 @@ ObjectData::ObjectData(V8Context* context_, Handle<Object> object_, SV* sv_)
 }
 
 ObjectData::~ObjectData() {
+    IsolateScope isolate_scope(context ? context->isolate : NULL);
     if (context) context->remove_object(this);
     object.Dispose();
 }
 
+void ObjectData::release() {
+    object.Dispose();
+    object.Clear();
+}
+
 PerlObjectData::PerlObjectData(V8Context* context_, Handle<Object> object_, SV* sv_)
     : ObjectData(context_, object_, sv_)
-    , bytes(size())
+    , bytes(0)
 {
     if (!sv)
         return;
 
     SvREFCNT_inc(sv);
-    add_size(calculate_size(sv));
+    add_size(size() + calculate_size(sv));
     ptr = PTR2IV(sv);
 
     object.MakeWeak(this, PerlObjectData::destroy);
@@ -197,6 +415,11 @@ int V8ObjectData::svt_free(pTHX_ SV* sv, MAGIC* mg) {
     return 0;
 };
 
+void PerlObjectData::release() {
+    // V8 won't get around to calling destroy() any more
+    delete this;
+}
+
 void PerlObjectData::destroy(Persistent<Value> object, void *data) {
     delete static_cast<PerlObjectData*>(data);
 }
@@ -228,24 +451,21 @@ protected:
     virtual Handle<Value> invoke(const Arguments& args);
     virtual size_t size();
 
+    PerlFunctionData(V8Context* context_, Handle<Object> object_, SV *cv)
+        : PerlObjectData(context_, object_, cv)
+        , rv(cv ? newRV_noinc(cv) : NULL)
+    { }
+
 public:
     PerlFunctionData(V8Context* context_, SV *cv)
-        : PerlObjectData(
-              context_,
-              Handle<Object>::Cast(
-                  context_->make_function->Call(
-                      context_->context->Global(),
-                      1,
-                      &External::Wrap(this)
-                  )
-              ),
-              cv
-          )
-       , rv(cv ? newRV_noinc(cv) : NULL)
+        : PerlObjectData(context_, context_->make_function(this), cv)
+        , rv(cv ? newRV_noinc(cv) : NULL)
     { }
 
+    // The JS side calls this with the holder made by make_function() as
+    // the receiver and the caller's own arguments.
     static Handle<Value> v8invoke(const Arguments& args) {
-        PerlFunctionData* data = static_cast<PerlFunctionData*>(External::Unwrap(args[0]));
+        PerlFunctionData* data = static_cast<PerlFunctionData*>(args.This()->GetPointerFromInternalField(0));
         return data->invoke(args);
     }
 };
@@ -266,213 +486,2240 @@ PerlFunctionData::invoke(const Arguments& args) {
     CONVERT_PERL_RESULT();
 }
 
+// Same check as the method cache of Perl itself: any change to the methods
+// of a class or its parents bumps its cache_gen, global changes bump
+// PL_sub_generation.
+static inline U32
+method_generation(HV* stash) {
+#if PERL_VERSION > 8
+    return PL_sub_generation + HvMROMETA(stash)->cache_gen;
+#else
+    return PL_sub_generation;
+#endif
+}
+
 class PerlMethodData : public PerlFunctionData {
 private:
     string name;
     virtual Handle<Value> invoke(const Arguments& args);
     virtual size_t size();
 
+    // Last method found, valid while the stash and generation match
+    HV* stash;
+    CV* method;
+    U32 generation;
+
+    CV* resolve(SV* self);
+
 public:
-    PerlMethodData(V8Context* context_, char* name_)
-        : PerlFunctionData(context_, NULL)
+    // Methods need the real receiver, so each gets a native function of its
+    // own. There is one per method of each bound package, and V8 keeps those
+    // for the life of the context anyway.
+    PerlMethodData(V8Context* context_, const char* name_)
+        : PerlFunctionData(
+              context_,
+              FunctionTemplate::New(PerlMethodData::v8invoke, External::Wrap(this))->GetFunction(),
+              NULL
+          )
         , name(name_)
+        , stash(NULL)
+        , method(NULL)
+        , generation(0)
+    { }
+
+    virtual ~PerlMethodData() {
+        SvREFCNT_dec(method);
+    }
+
+    static Handle<Value> v8invoke(const Arguments& args) {
+        PerlMethodData* data = static_cast<PerlMethodData*>(External::Unwrap(args.Data()));
+        return data->invoke(args);
+    }
+};
+
+// AUTOLOAD and missing methods are left to call_method()
+CV*
+PerlMethodData::resolve(SV* self) {
+#if PERL_VERSION > 8
+    if (!SvROK(self) || !SvOBJECT(SvRV(self)))
+        return NULL;
+
+    HV *self_stash = SvSTASH(SvRV(self));
+    U32 self_generation = method_generation(self_stash);
+
+    if (self_stash != stash || self_generation != generation) {
+        GV *gv = gv_fetchmethod_autoload(self_stash, name.c_str(), FALSE);
+        CV *found = gv && isGV(gv) ? GvCV(gv) : NULL;
+
+        SvREFCNT_inc(found);
+        SvREFCNT_dec(method);
+        method = found;
+        stash = self_stash;
+        generation = self_generation;
+    }
+
+    return method;
+#else
+    return NULL;
+#endif
+}
+
+Handle<Value>
+PerlMethodData::invoke(const Arguments& args) {
+    SV *self = context->v82sv(args.This());
+    CV *cv = resolve(self);
+
+    SETUP_PERL_CALL(mPUSHs(self))
+    int count = cv
+        ? call_sv((SV*)cv, G_SCALAR | G_EVAL)
+        : call_method(name.c_str(), G_SCALAR | G_EVAL);
+    CONVERT_PERL_RESULT()
+}
+
+size_t PerlMethodData::size() {
+    return sizeof(PerlMethodData);
+}
+
+// Prototype shared by the objects of one Perl package. Methods are looked up
+// through a named interceptor the first time a script asks for them, and
+// remembered. Names which turned out not to be methods are asked again
+// once methods of the package change.
+class PerlPrototype {
+public:
+    V8Context* context;
+    HV* stash;
+    Persistent<Object> object;
+
+    PerlPrototype(V8Context* context_, HV* stash_, Handle<Object> object_)
+        : context(context_)
+        , stash((HV*)SvREFCNT_inc((SV*)stash_)) // so the address can't be reused
+        , object(Persistent<Object>::New(object_))
+        , generation(method_generation(stash_))
+    {
+        object->SetPointerInInternalField(0, this);
+    }
+
+    ~PerlPrototype() {
+        for (map<string, PerlMethodData*>::iterator it = methods.begin(); it != methods.end(); it++)
+            delete it->second;
+        object.Dispose();
+        SvREFCNT_dec((SV*)stash);
+    }
+
+    PerlMethodData* method(Local<String> property);
+
+    static Handle<Value> get(Local<String> property, const AccessorInfo& info);
+    static Handle<Integer> query(Local<String> property, const AccessorInfo& info);
+
+private:
+    map<string, PerlMethodData*> methods;
+    U32 generation;
+};
+
+PerlMethodData*
+PerlPrototype::method(Local<String> property) {
+    U32 current = method_generation(stash);
+    if (current != generation) {
+        for (map<string, PerlMethodData*>::iterator it = methods.begin(); it != methods.end(); ) {
+            if (it->second)
+                it++;
+            else
+                methods.erase(it++);
+        }
+        generation = current;
+    }
+
+    String::Utf8Value utf8(property);
+    string name(*utf8, utf8.length());
+
+    map<string, PerlMethodData*>::iterator it = methods.find(name);
+    if (it != methods.end())
+        return it->second;
+
+    PerlMethodData* data = NULL;
+
+    // Whatever Object.prototype has stays JavaScript
+    if (!object->GetPrototype()->ToObject()->Has(property)) {
+        GV *gv = gv_fetchmethod_autoload(stash, name.c_str(), FALSE);
+        if (gv && isGV(gv) && GvCV(gv))
+            data = new PerlMethodData(context, name.c_str());
+    }
+
+    return methods[name] = data;
+}
+
+Handle<Value>
+PerlPrototype::get(Local<String> property, const AccessorInfo& info) {
+    PerlPrototype* self = static_cast<PerlPrototype*>(info.Holder()->GetPointerFromInternalField(0));
+    PerlMethodData* data = self->method(property);
+    return data ? Handle<Value>(data->object) : Handle<Value>();
+}
+
+Handle<Integer>
+PerlPrototype::query(Local<String> property, const AccessorInfo& info) {
+    PerlPrototype* self = static_cast<PerlPrototype*>(info.Holder()->GetPointerFromInternalField(0));
+    return self->method(property) ? Integer::New(DontEnum) : Handle<Integer>();
+}
+
+// The PV of a scalar given to bind_buffer() is the element storage of a
+// V8 object, so the scalar must not be reallocated while V8 can see it.
+// It is read-only until unbind_buffer(), the end of the context or the
+// collection of the object, whichever comes first.
+class PerlBufferData : public PerlObjectData {
+private:
+    bool was_readonly;
+    bool bound;
+    virtual size_t size();
+
+public:
+    PerlBufferData(V8Context* context_, Handle<Object> object_, SV* sv_)
+        : PerlObjectData(context_, object_, sv_)
+        , was_readonly(SvREADONLY(sv_))
+        , bound(true)
+    {
+        SvREADONLY_on(sv);
+    }
+
+    virtual ~PerlBufferData() {
+        if (bound && !was_readonly)
+            SvREADONLY_off(sv);
+    }
+
+    void unbind();
+};
+
+// Scripts holding on to the object see an empty buffer from now on
+void PerlBufferData::unbind() {
+    if (!bound)
+        return;
+
+    static char empty[1];
+    object->SetIndexedPropertiesToExternalArrayData(empty, kExternalUnsignedByteArray, 0);
+
+    PropertyAttribute attributes = PropertyAttribute(ReadOnly | DontEnum | DontDelete);
+    object->ForceSet(String::New("length"), Integer::New(0), attributes);
+    object->ForceSet(String::New("byteLength"), Integer::New(0), attributes);
+
+    if (!was_readonly)
+        SvREADONLY_off(sv);
+    bound = false;
+}
+
+size_t PerlBufferData::size() {
+    return sizeof(PerlBufferData);
+}
+
+// Objects made by bind_live() keep the PerlObjectData of their AV or HV in
+// an internal field and read and write the Perl container on every access.
+static PerlObjectData*
+live_data(const AccessorInfo& info) {
+    return static_cast<PerlObjectData*>(info.Holder()->GetPointerFromInternalField(0));
+}
+
+// Perl dies on readonly arrays, restricted hashes and in the methods of
+// tied containers, which must not unwind through V8 frames. For such
+// containers the access runs inside a Perl eval, through an XSUB calling
+// back into the LiveOp it is given. Plain containers are accessed directly.
+struct LiveOp {
+    void (*run)(LiveOp&);
+    SV* container;
+    SSize_t index;
+    const char* key;
+    I32 klen;
+    SV* value;   // value to store, or value found
+    bool done;   // value was stored, or found
+    bool owned;  // value found is ours to free
+
+    LiveOp(void (*run_)(LiveOp&), SV* container_)
+        : run(run_), container(container_), index(0), key(NULL), klen(0)
+        , value(NULL), done(false), owned(false)
     { }
+
+    // Values of tied containers are fetched into a copy
+    void found(SV** sv) {
+        if (!sv)
+            return;
+        done = true;
+        if (SvGMAGICAL(*sv) || SvRMAGICAL(container)) {
+            value = newSVsv(*sv);
+            owned = true;
+        }
+        else {
+            value = *sv;
+        }
+    }
 };
 
-Handle<Value>
-PerlMethodData::invoke(const Arguments& args) {
-    SETUP_PERL_CALL(mXPUSHs(context->v82sv(args.This())))
-    int count = call_method(name.c_str(), G_SCALAR | G_EVAL);
-    CONVERT_PERL_RESULT()
+XS(live_op) {
+    dXSARGS;
+    PERL_UNUSED_VAR(items);
+    LiveOp* op = INT2PTR(LiveOp*, SvIV(ST(0)));
+    op->run(*op);
+    XSRETURN_EMPTY;
+}
+
+static bool
+live_call(LiveOp& op) {
+    if (!SvRMAGICAL(op.container) && !SvREADONLY(op.container)) {
+        op.run(op);
+        return true;
+    }
+
+    CV* cv = get_cv("JavaScript::V8::Context::_live_op", 0);
+    if (!cv)
+        cv = newXS("JavaScript::V8::Context::_live_op", live_op, __FILE__);
+
+    dSP;
+    ENTER;
+    SAVETMPS;
+    PUSHMARK(SP);
+    mXPUSHi(PTR2IV(&op));
+    PUTBACK;
+    call_sv((SV*)cv, G_EVAL | G_DISCARD);
+    FREETMPS;
+    LEAVE;
+
+    return !SvTRUE(ERRSV);
+}
+
+static void live_av_fetch(LiveOp& op) { op.found(av_fetch((AV*)op.container, op.index, 0)); }
+static void live_av_store(LiveOp& op) { op.done = av_store((AV*)op.container, op.index, op.value); }
+static void live_av_exists(LiveOp& op) { op.done = av_exists((AV*)op.container, op.index); }
+static void live_av_delete(LiveOp& op) { av_delete((AV*)op.container, op.index, G_DISCARD); }
+static void live_av_len(LiveOp& op) { op.index = av_len((AV*)op.container); }
+static void live_av_fill(LiveOp& op) { av_fill((AV*)op.container, op.index); }
+
+static void live_hv_fetch(LiveOp& op) { op.found(hv_fetch((HV*)op.container, op.key, op.klen, 0)); }
+static void live_hv_store(LiveOp& op) { op.done = hv_store((HV*)op.container, op.key, op.klen, op.value, 0); }
+static void live_hv_exists(LiveOp& op) { op.done = hv_exists((HV*)op.container, op.key, op.klen); }
+static void live_hv_delete(LiveOp& op) { hv_delete((HV*)op.container, op.key, op.klen, G_DISCARD); }
+
+// Keys of a tied hash, through FIRSTKEY and NEXTKEY
+static void
+live_hv_keys(LiveOp& op) {
+    HV* hv = (HV*)op.container;
+    AV* keys = newAV();
+    op.value = (SV*)keys;
+    op.owned = true;
+
+    HE *he;
+    hv_iterinit(hv);
+    while ((he = hv_iternext(hv)))
+        av_push(keys, newSVsv(hv_iterkeysv(he)));
+}
+
+// Stored values are only owned by the container if it says so
+static void
+live_stored(LiveOp& op) {
+    if (!op.done)
+        SvREFCNT_dec(op.value);
+}
+
+static Handle<Value>
+live_found(LiveOp& op, PerlObjectData* data) {
+    if (!op.done)
+        return Handle<Value>();
+    Handle<Value> value = data->context->live2v8(op.value);
+    if (op.owned)
+        SvREFCNT_dec(op.value);
+    return value;
+}
+
+static Handle<Value>
+live_array_get(uint32_t index, const AccessorInfo& info) {
+    PerlObjectData* data = live_data(info);
+    LiveOp op(live_av_fetch, data->sv);
+    op.index = index;
+    if (!live_call(op))
+        return check_perl_error();
+    return live_found(op, data);
+}
+
+static Handle<Value>
+live_array_set(uint32_t index, Local<Value> value, const AccessorInfo& info) {
+    PerlObjectData* data = live_data(info);
+    LiveOp op(live_av_store, data->sv);
+    op.index = index;
+    op.value = data->context->v82sv(value);
+    bool ok = live_call(op);
+    live_stored(op);
+    return ok ? (Handle<Value>)value : check_perl_error();
+}
+
+static Handle<Integer>
+live_array_query(uint32_t index, const AccessorInfo& info) {
+    LiveOp op(live_av_exists, live_data(info)->sv);
+    op.index = index;
+    if (!live_call(op))
+        check_perl_error();
+    if (!op.done)
+        return Handle<Integer>();
+    return Integer::New(None);
+}
+
+static Handle<Boolean>
+live_array_delete(uint32_t index, const AccessorInfo& info) {
+    LiveOp op(live_av_delete, live_data(info)->sv);
+    op.index = index;
+    if (!live_call(op)) {
+        check_perl_error();
+        return False();
+    }
+    return True();
+}
+
+static Handle<Array>
+live_array_keys(const AccessorInfo& info) {
+    LiveOp op(live_av_len, live_data(info)->sv);
+    if (!live_call(op)) {
+        check_perl_error();
+        return Handle<Array>();
+    }
+
+    I32 len = op.index + 1;
+    Handle<Array> keys = Array::New(len);
+    for (I32 i = 0; i < len; i++)
+        keys->Set(i, Integer::New(i));
+    return keys;
+}
+
+static Handle<Value>
+live_array_length(Local<String> property, const AccessorInfo& info) {
+    LiveOp op(live_av_len, live_data(info)->sv);
+    if (!live_call(op))
+        return check_perl_error();
+    return Integer::New(op.index + 1);
+}
+
+static void
+live_array_set_length(Local<String> property, Local<Value> value, const AccessorInfo& info) {
+    LiveOp op(live_av_fill, live_data(info)->sv);
+    op.index = value->Int32Value() - 1;
+    if (!live_call(op))
+        check_perl_error();
+}
+
+static Handle<Value>
+live_hash_get(Local<String> property, const AccessorInfo& info) {
+    PerlObjectData* data = live_data(info);
+    String::Utf8Value key(property);
+    LiveOp op(live_hv_fetch, data->sv);
+    op.key = *key;
+    op.klen = -key.length();
+    if (!live_call(op))
+        return check_perl_error();
+    return live_found(op, data);
+}
+
+static Handle<Value>
+live_hash_set(Local<String> property, Local<Value> value, const AccessorInfo& info) {
+    PerlObjectData* data = live_data(info);
+    String::Utf8Value key(property);
+    LiveOp op(live_hv_store, data->sv);
+    op.key = *key;
+    op.klen = -key.length();
+    op.value = data->context->v82sv(value);
+    bool ok = live_call(op);
+    live_stored(op);
+    return ok ? (Handle<Value>)value : check_perl_error();
+}
+
+static Handle<Integer>
+live_hash_query(Local<String> property, const AccessorInfo& info) {
+    String::Utf8Value key(property);
+    LiveOp op(live_hv_exists, live_data(info)->sv);
+    op.key = *key;
+    op.klen = -key.length();
+    if (!live_call(op))
+        check_perl_error();
+    if (!op.done)
+        return Handle<Integer>();
+    return Integer::New(None);
+}
+
+static Handle<Boolean>
+live_hash_delete(Local<String> property, const AccessorInfo& info) {
+    String::Utf8Value key(property);
+    LiveOp op(live_hv_delete, live_data(info)->sv);
+    op.key = *key;
+    op.klen = -key.length();
+    if (!live_call(op)) {
+        check_perl_error();
+        return False();
+    }
+    return True();
+}
+
+// Plain hashes are read bucket by bucket, as hv_iterinit() would restart
+// an each() loop over the hash in Perl. Tied hashes are iterated through
+// their FIRSTKEY and NEXTKEY methods, which may do just that.
+static Handle<Array>
+live_hash_keys(const AccessorInfo& info) {
+    PerlObjectData* data = live_data(info);
+    HV *hv = (HV*)data->sv;
+
+    if (SvRMAGICAL(hv)) {
+        LiveOp op(live_hv_keys, data->sv);
+        if (!live_call(op)) {
+            SvREFCNT_dec(op.value);
+            check_perl_error();
+            return Handle<Array>();
+        }
+
+        AV *av = (AV*)op.value;
+        I32 len = av_len(av) + 1;
+        Handle<Array> keys = Array::New(len);
+        for (I32 i = 0; i < len; i++)
+            keys->Set(i, data->context->sv2v8(AvARRAY(av)[i]));
+        SvREFCNT_dec(av);
+        return keys;
+    }
+
+    Handle<Array> keys = Array::New(HvUSEDKEYS(hv));
+    if (!HvARRAY(hv))
+        return keys;
+
+    uint32_t i = 0;
+    for (STRLEN bucket = 0; bucket <= HvMAX(hv); bucket++) {
+        for (HE *he = HvARRAY(hv)[bucket]; he; he = HeNEXT(he)) {
+            if (HeVAL(he) != &PL_sv_placeholder)
+                keys->Set(i++, data->context->sv2v8(hv_iterkeysv(he)));
+        }
+    }
+
+    return keys;
+}
+
+// A single watchdog thread per process terminates scripts which run past
+// their deadline. Each timed eval adds a timer and removes it when done, so
+// no thread is created or joined per eval.
+struct watchdog_timer;
+typedef multimap<long long, watchdog_timer*> watchdog_timer_map;
+
+struct watchdog_timer {
+    Isolate* isolate;
+    pthread_t thread;  // running the script
+    bool fired;
+    bool cpu;          // budget is in CPU time of the thread below
+    clockid_t clock;
+    long long budget;  // microseconds on clock to fire at
+    watchdog_timer_map::iterator it;
+};
+
+class watchdog {
+public:
+    static void add(long long deadline, watchdog_timer* timer) {
+        pthread_mutex_lock(&mutex_);
+
+        if (!running_)
+            start();
+
+        timer->it = timers_.insert(pair<long long, watchdog_timer*>(deadline, timer));
+        if (timer->it == timers_.begin())
+            pthread_cond_signal(&cond_); // new earliest deadline
+
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    static void remove(watchdog_timer* timer) {
+        pthread_mutex_lock(&mutex_);
+        if (!timer->fired)
+            timers_.erase(timer->it);
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    static long long now() {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+    }
+
+    static long long now(clockid_t clock) {
+        struct timespec ts;
+        clock_gettime(clock, &ts);
+        return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }
+
+private:
+    static void start() {
+        pthread_t id;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        running_ = pthread_create(&id, &attr, run, NULL) == 0;
+        pthread_attr_destroy(&attr);
+    }
+
+    static void* run(void*) {
+        pthread_mutex_lock(&mutex_);
+
+        for (;;) {
+            if (timers_.empty()) {
+                pthread_cond_wait(&cond_, &mutex_);
+                continue;
+            }
+
+            watchdog_timer_map::iterator first = timers_.begin();
+            if (first->first <= now()) {
+                watchdog_timer* timer = first->second;
+                timers_.erase(first);
+
+                // A thread can't use more CPU time than wall time, so check
+                // again once the rest of the budget could have been used.
+                if (timer->cpu) {
+                    long long left = timer->budget - now(timer->clock);
+                    if (left > 0) {
+                        timer->it = timers_.insert(pair<long long, watchdog_timer*>(now() + left, timer));
+                        continue;
+                    }
+                }
+
+                timer->fired = true;
+                V8::TerminateExecution(timer->isolate);
+                continue;
+            }
+
+            struct timespec ts;
+            ts.tv_sec = first->first / 1000000;
+            ts.tv_nsec = (first->first % 1000000) * 1000;
+            pthread_cond_timedwait(&cond_, &mutex_, &ts);
+        }
+
+        return NULL;
+    }
+
+    // The thread doesn't survive fork(), the child starts its own on demand.
+    // Only the forking thread does either, so timers of scripts running in
+    // other threads are dropped. A CPU clock names the thread it measures,
+    // the forking thread's own timers move to its clock in the child.
+    static void atfork_child() {
+        pthread_mutex_init(&mutex_, NULL);
+        pthread_cond_init(&cond_, NULL);
+        running_ = false;
+
+        pthread_t self = pthread_self();
+        for (watchdog_timer_map::iterator it = timers_.begin(); it != timers_.end(); ) {
+            watchdog_timer* timer = it->second;
+            if (!pthread_equal(timer->thread, self)) {
+                timers_.erase(it++);
+                continue;
+            }
+#ifdef _POSIX_THREAD_CPUTIME
+            if (timer->cpu && timer->clock != CLOCK_REALTIME)
+                pthread_getcpuclockid(self, &timer->clock);
+#endif
+            it++;
+        }
+
+        if (!timers_.empty())
+            start();
+    }
+
+    static int register_atfork() {
+        return pthread_atfork(NULL, NULL, atfork_child);
+    }
+
+    static pthread_mutex_t mutex_;
+    static pthread_cond_t cond_;
+    static bool running_;
+    static watchdog_timer_map timers_;
+    static int atfork_;
+};
+
+pthread_mutex_t watchdog::mutex_ = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t watchdog::cond_ = PTHREAD_COND_INITIALIZER;
+bool watchdog::running_ = false;
+watchdog_timer_map watchdog::timers_;
+int watchdog::atfork_ = watchdog::register_atfork();
+
+class thread_canceller {
+public:
+    thread_canceller(int ms, int cpu_ms = 0)
+        : ms_(ms)
+        , cpu_ms_(cpu_ms)
+    {
+        if (ms_) {
+            wall_.isolate = Isolate::GetCurrent();
+            wall_.thread = pthread_self();
+            wall_.fired = false;
+            wall_.cpu = false;
+            watchdog::add(watchdog::now() + (long long)ms_ * 1000, &wall_);
+        }
+
+        if (cpu_ms_) {
+            cpu_.isolate = Isolate::GetCurrent();
+            cpu_.thread = pthread_self();
+            cpu_.fired = false;
+            cpu_.cpu = true;
+#ifdef _POSIX_THREAD_CPUTIME
+            if (pthread_getcpuclockid(pthread_self(), &cpu_.clock) != 0)
+#endif
+                cpu_.clock = CLOCK_REALTIME; // no CPU clock, fall back to wall time
+            cpu_.budget = watchdog::now(cpu_.clock) + (long long)cpu_ms_ * 1000;
+            watchdog::add(watchdog::now() + (long long)cpu_ms_ * 1000, &cpu_);
+        }
+    }
+
+    ~thread_canceller() {
+        if (ms_)
+            watchdog::remove(&wall_);
+        if (cpu_ms_)
+            watchdog::remove(&cpu_);
+    }
+
+    // Which limit terminated the script, if any
+    const char* reason() const {
+        if (ms_ && wall_.fired)
+            return "time limit";
+        if (cpu_ms_ && cpu_.fired)
+            return "CPU time limit";
+        return NULL;
+    }
+
+private:
+    watchdog_timer wall_;
+    watchdog_timer cpu_;
+    int ms_;
+    int cpu_ms_;
+};
+
+// Stops the running script with a catchable error once the heap gets close
+// to its limit, before V8 runs out of memory and aborts the process. V8 has
+// no near-heap-limit callback, so this looks at the heap after every GC.
+class heap_limiter {
+public:
+    heap_limiter(size_t limit)
+        : limit_(limit)
+        , exceeded_(false)
+        , previous_(current_)
+    {
+        if (limit_)
+            current_ = this;
+    }
+
+    ~heap_limiter() {
+        if (limit_)
+            current_ = previous_;
+    }
+
+    bool exceeded() const {
+        return exceeded_;
+    }
+
+    static void gc_epilogue(GCType type, GCCallbackFlags flags) {
+        heap_limiter* me = current_;
+        if (!me || me->exceeded_)
+            return;
+
+        HeapStatistics stats;
+        V8::GetHeapStatistics(&stats);
+
+        if (stats.used_heap_size() > me->limit_) {
+            me->exceeded_ = true;
+            V8::TerminateExecution(Isolate::GetCurrent());
+        }
+    }
+
+private:
+    size_t limit_;
+    bool exceeded_;
+    heap_limiter* previous_;
+
+    static __thread heap_limiter* current_;
+};
+
+__thread heap_limiter* heap_limiter::current_ = NULL;
+
+// V8 takes space sizes in bytes as an int, Context.pm rejects larger sizes
+static int
+space_size_bytes(int megabytes) {
+    intptr_t bytes = (intptr_t)megabytes * MB;
+    return bytes > INT_MAX ? INT_MAX : (int)bytes;
+}
+
+// Applies heap size limits to the current isolate. Returns the heap size at
+// which running scripts get terminated, 0 for no limit. Sets applied to
+// false if the sizes came too late; workers have no Perl to warn through,
+// so warning is left to the caller.
+static size_t
+configure_heap(bool own_isolate, int max_young_space_size, int max_old_space_size, bool& applied) {
+    applied = true;
+    if (max_young_space_size || max_old_space_size) {
+        // Only has an effect if the heap has not been set up yet
+        ResourceConstraints constraints;
+        if (max_young_space_size)
+            constraints.set_max_young_space_size(space_size_bytes(max_young_space_size));
+        if (max_old_space_size)
+            constraints.set_max_old_space_size(space_size_bytes(max_old_space_size));
+        applied = SetResourceConstraints(&constraints);
+    }
+
+    if (!max_old_space_size)
+        return 0;
+
+    // GC callbacks are kept per isolate
+    static bool gc_epilogue_added = false;
+    if (own_isolate) {
+        V8::AddGCEpilogueCallback(heap_limiter::gc_epilogue);
+    }
+    else if (!gc_epilogue_added) {
+        V8::AddGCEpilogueCallback(heap_limiter::gc_epilogue);
+        gc_epilogue_added = true;
+    }
+
+    return (size_t)max_old_space_size * MB / 100 * HEAP_LIMIT_PERCENT;
+}
+
+// Values cross threads and isolates in a flat buffer: a tag byte followed
+// by the payload in native byte order. Containers are numbered in the order
+// they start, so repeated or cyclic references become a SER_REF.
+enum {
+    SER_UNDEF  = 'u',
+    SER_TRUE   = 'T',
+    SER_FALSE  = 'F',
+    SER_INT    = 'i', // int32
+    SER_DOUBLE = 'd',
+    SER_STRING = 's', // u32 length, UTF-8 bytes
+    SER_ARRAY  = 'a', // u32 length, elements
+    SER_HASH   = 'h', // u32 count, (u32 length, UTF-8 key, value) pairs
+    SER_REF    = 'r'  // u32 index of an earlier container
+};
+
+class V8Encoder {
+public:
+    V8Encoder(string& buf_)
+        : buf(buf_)
+        , count(0)
+    { }
+
+    void encode(Handle<Value> value);
+
+private:
+    typedef multimap<int, pair<Handle<Object>, uint32_t> > object_map;
+
+    string& buf;
+    object_map seen;
+    uint32_t count;
+
+    void put(const void* data, size_t len) {
+        buf.append((const char*)data, len);
+    }
+
+    void put_u32(uint32_t v) {
+        put(&v, sizeof(v));
+    }
+
+    void put_string(Handle<String> str);
+    bool put_seen(Handle<Object> object);
+};
+
+void V8Encoder::put_string(Handle<String> str) {
+    int len = str->Utf8Length();
+    put_u32(len);
+
+    size_t pos = buf.size();
+    buf.resize(pos + len);
+    if (len)
+        str->WriteUtf8(&buf[pos], len, NULL, String::NO_NULL_TERMINATION);
+}
+
+bool V8Encoder::put_seen(Handle<Object> object) {
+    int hash = object->GetIdentityHash();
+
+    pair<object_map::iterator, object_map::iterator> range = seen.equal_range(hash);
+    for (object_map::iterator it = range.first; it != range.second; it++) {
+        if (it->second.first->StrictEquals(object)) {
+            buf += (char)SER_REF;
+            put_u32(it->second.second);
+            return true;
+        }
+    }
+
+    seen.insert(make_pair(hash, make_pair(object, count++)));
+    return false;
+}
+
+void V8Encoder::encode(Handle<Value> value) {
+    if (value->IsInt32()) {
+        int32_t v = value->Int32Value();
+        buf += (char)SER_INT;
+        put(&v, sizeof(v));
+    }
+    else if (value->IsBoolean()) {
+        buf += (char)(value->IsTrue() ? SER_TRUE : SER_FALSE);
+    }
+    else if (value->IsNumber()) {
+        double v = value->NumberValue();
+        buf += (char)SER_DOUBLE;
+        put(&v, sizeof(v));
+    }
+    else if (value->IsString()) {
+        buf += (char)SER_STRING;
+        put_string(Handle<String>::Cast(value));
+    }
+    else if (value->IsArray()) {
+        Handle<Array> array = Handle<Array>::Cast(value);
+        if (put_seen(array))
+            return;
+
+        uint32_t len = array->Length();
+        buf += (char)SER_ARRAY;
+        put_u32(len);
+        for (uint32_t i = 0; i < len; i++)
+            encode(array->Get(i));
+    }
+    else if (value->IsObject() && !value->IsFunction()) {
+        Handle<Object> object = Handle<Object>::Cast(value);
+        if (put_seen(object))
+            return;
+
+        Local<Array> properties = object->GetPropertyNames();
+        uint32_t len = properties->Length();
+        buf += (char)SER_HASH;
+        put_u32(len);
+        for (uint32_t i = 0; i < len; i++) {
+            Local<String> name = properties->Get(i)->ToString();
+            put_string(name);
+            encode(object->Get(name));
+        }
+    }
+    else {
+        // undefined, null and functions, which can't cross over
+        buf += (char)SER_UNDEF;
+    }
+}
+
+class SvDecoder {
+public:
+    SvDecoder(const string& buf)
+        : p(buf.data())
+        , end(buf.data() + buf.size())
+    { }
+
+    SV* decode();
+
+private:
+    const char* p;
+    const char* end;
+    vector<SV*> seen;
+
+    bool get(void* data, size_t len) {
+        if ((size_t)(end - p) < len)
+            return false;
+        memcpy(data, p, len);
+        p += len;
+        return true;
+    }
+
+    uint32_t get_u32() {
+        uint32_t v = 0;
+        get(&v, sizeof(v));
+        return v;
+    }
+
+    SV* get_string();
+};
+
+SV* SvDecoder::get_string() {
+    uint32_t len = get_u32();
+    if ((size_t)(end - p) < len)
+        return newSV(0);
+
+    SV* sv = newSVpvn(p, len);
+    if (!is_ascii(p, len))
+        SvUTF8_on(sv);
+    p += len;
+    return sv;
+}
+
+SV* SvDecoder::decode() {
+    char tag = 0;
+    if (!get(&tag, 1))
+        return newSV(0);
+
+    switch (tag) {
+        case SER_TRUE:
+            return newSVuv(1);
+        case SER_FALSE:
+            return newSVuv(0);
+        case SER_INT: {
+            int32_t v;
+            get(&v, sizeof(v));
+            return newSViv(v);
+        }
+        case SER_DOUBLE: {
+            double v;
+            get(&v, sizeof(v));
+            return newSVnv(v);
+        }
+        case SER_STRING:
+            return get_string();
+        case SER_ARRAY: {
+            AV *av = newAV();
+            seen.push_back((SV*)av);
+            uint32_t len = get_u32();
+            av_extend(av, len);
+            for (uint32_t i = 0; i < len; i++)
+                av_push(av, decode());
+            return newRV_noinc((SV*)av);
+        }
+        case SER_HASH: {
+            HV *hv = newHV();
+            seen.push_back((SV*)hv);
+            uint32_t len = get_u32();
+            for (uint32_t i = 0; i < len; i++) {
+                SV *key = get_string();
+                hv_store_ent(hv, key, decode(), 0);
+                SvREFCNT_dec(key);
+            }
+            return newRV_noinc((SV*)hv);
+        }
+        case SER_REF: {
+            uint32_t index = get_u32();
+            if (index < seen.size())
+                return newRV_inc(seen[index]);
+            return newSV(0);
+        }
+    }
+
+    return newSV(0);
+}
+
+// Perl containers already written by an SvEncoder, by address
+struct SerialSlot {
+    SV* sv;
+    uint32_t index;
+
+    SerialSlot() : sv(NULL), index(0) { }
+
+    bool empty() const { return !sv; }
+    size_t hash() const { return pointer_hash(sv); }
+};
+
+class SvEncoder : public FlatTable<SerialSlot> {
+public:
+    SvEncoder(string& buf_)
+        : buf(buf_)
+        , count(0)
+    { }
+
+    void encode(SV* sv);
+
+private:
+    string& buf;
+    uint32_t count;
+
+    void put(const void* data, size_t len) {
+        buf.append((const char*)data, len);
+    }
+
+    void put_u32(uint32_t v) {
+        put(&v, sizeof(v));
+    }
+
+    void put_string(const char* str, STRLEN len, bool utf8);
+    bool put_seen(SV* sv);
+};
+
+void SvEncoder::put_string(const char* str, STRLEN len, bool utf8) {
+    if (utf8 || is_ascii(str, len)) {
+        put_u32(len);
+        put(str, len);
+        return;
+    }
+
+    // Latin-1, every byte above 0x7f takes two in UTF-8
+    size_t pos = buf.size();
+    put_u32(0);
+    for (STRLEN i = 0; i < len; i++) {
+        unsigned char c = str[i];
+        if (c < 0x80) {
+            buf += (char)c;
+        }
+        else {
+            buf += (char)(0xc0 | c >> 6);
+            buf += (char)(0x80 | (c & 0x3f));
+        }
+    }
+    uint32_t utf8_len = buf.size() - pos - sizeof(uint32_t);
+    memcpy(&buf[pos], &utf8_len, sizeof(utf8_len));
+}
+
+bool SvEncoder::put_seen(SV* sv) {
+    size_t hash = pointer_hash(sv);
+
+    if (used) {
+        for (size_t i = hash & mask(); !(*slots)[i].empty(); i = (i + 1) & mask()) {
+            if ((*slots)[i].sv == sv) {
+                buf += (char)SER_REF;
+                put_u32((*slots)[i].index);
+                return true;
+            }
+        }
+    }
+
+    SerialSlot& slot = insert(hash);
+    slot.sv = sv;
+    slot.index = count++;
+    return false;
+}
+
+// Follows the same rules as V8Context::sv2v8()
+void SvEncoder::encode(SV* sv) {
+    SvGETMAGIC(sv); // elements of tied containers
+
+    if (SvROK(sv)) {
+        SV *ref = SvRV(sv);
+        unsigned t = SvTYPE(ref);
+
+        if (SvOBJECT(ref) || (t != SVt_PVAV && t != SVt_PVHV)) {
+            // objects and code can't be copied
+            buf += (char)SER_UNDEF;
+        }
+        else if (put_seen(ref)) {
+            return;
+        }
+        else if (t == SVt_PVAV) {
+            AV *av = (AV*)ref;
+            uint32_t len = av_len(av) + 1;
+            buf += (char)SER_ARRAY;
+            put_u32(len);
+            for (uint32_t i = 0; i < len; i++) {
+                SV **elem = av_fetch(av, i, 0);
+                if (elem)
+                    encode(*elem);
+                else
+                    buf += (char)SER_UNDEF;
+            }
+        }
+        else {
+            HV *hv = (HV*)ref;
+            buf += (char)SER_HASH;
+
+            // Tied hashes don't know their size and restricted ones count
+            // placeholders, so the pairs are counted as they are written
+            size_t pos = buf.size();
+            uint32_t pairs = 0;
+            put_u32(0);
+
+            hv_iterinit(hv);
+            while (HE *he = hv_iternext(hv)) {
+                STRLEN len;
+                SV *key = hv_iterkeysv(he);
+                const char *str = SvPV(key, len);
+                put_string(str, len, SvUTF8(key));
+                encode(hv_iterval(hv, he));
+                pairs++;
+            }
+            memcpy(&buf[pos], &pairs, sizeof(pairs));
+        }
+    }
+    else if (SvPOK(sv)) {
+        STRLEN len;
+        const char *str = SvPV(sv, len);
+        buf += (char)SER_STRING;
+        put_string(str, len, SvUTF8(sv));
+    }
+    else if (SvIOK(sv)) {
+        IV v = SvIV(sv);
+        if (!SvIsUV(sv) && v <= INT32_MAX && v >= INT32_MIN) {
+            int32_t i = v;
+            buf += (char)SER_INT;
+            put(&i, sizeof(i));
+        }
+        else {
+            double d = SvNV(sv);
+            buf += (char)SER_DOUBLE;
+            put(&d, sizeof(d));
+        }
+    }
+    else if (SvNOK(sv)) {
+        double d = SvNV(sv);
+        buf += (char)SER_DOUBLE;
+        put(&d, sizeof(d));
+    }
+    else {
+        buf += (char)SER_UNDEF;
+    }
+}
+
+class V8Decoder {
+public:
+    V8Decoder(const string& buf)
+        : p(buf.data())
+        , end(buf.data() + buf.size())
+    { }
+
+    Handle<Value> decode();
+
+private:
+    const char* p;
+    const char* end;
+    vector<Handle<Object> > seen;
+
+    bool get(void* data, size_t len) {
+        if ((size_t)(end - p) < len)
+            return false;
+        memcpy(data, p, len);
+        p += len;
+        return true;
+    }
+
+    uint32_t get_u32() {
+        uint32_t v = 0;
+        get(&v, sizeof(v));
+        return v;
+    }
+
+    Handle<String> get_string();
+};
+
+Handle<String> V8Decoder::get_string() {
+    uint32_t len = get_u32();
+    if ((size_t)(end - p) < len)
+        return String::Empty();
+
+    Handle<String> str = String::New(p, len);
+    p += len;
+    return str;
+}
+
+Handle<Value> V8Decoder::decode() {
+    char tag = 0;
+    if (!get(&tag, 1))
+        return Undefined();
+
+    switch (tag) {
+        case SER_TRUE:
+            return True();
+        case SER_FALSE:
+            return False();
+        case SER_INT: {
+            int32_t v;
+            get(&v, sizeof(v));
+            return Integer::New(v);
+        }
+        case SER_DOUBLE: {
+            double v;
+            get(&v, sizeof(v));
+            return Number::New(v);
+        }
+        case SER_STRING:
+            return get_string();
+        case SER_ARRAY: {
+            uint32_t len = get_u32();
+            Handle<Array> array = Array::New(len);
+            seen.push_back(array);
+            for (uint32_t i = 0; i < len; i++)
+                array->Set(i, decode());
+            return array;
+        }
+        case SER_HASH: {
+            Handle<Object> object = Object::New();
+            seen.push_back(object);
+            uint32_t len = get_u32();
+            for (uint32_t i = 0; i < len; i++) {
+                Handle<String> key = get_string();
+                object->Set(key, decode());
+            }
+            return object;
+        }
+        case SER_REF: {
+            uint32_t index = get_u32();
+            if (index < seen.size())
+                return seen[index];
+            return Undefined();
+        }
+    }
+
+    return Undefined();
+}
+
+class AsyncJob {
+public:
+    long id;
+    string source;
+    bool ok;
+    string result; // encoded value, or the error message
+};
+
+// Native threads running scripts passed to eval_async(), each in a fresh
+// context of its own isolate. Finished jobs are queued and announced with a
+// byte on a pipe so an event loop can watch for them.
+class WorkerPool {
+public:
+    WorkerPool(int size, int time_limit_ms, int cpu_time_limit_ms, int max_young_space_size, int max_old_space_size);
+    ~WorkerPool();
+
+    void submit(AsyncJob* job);
+    AsyncJob* finished();
+    void wait();
+
+    int fd() const { return fds[0]; }
+
+private:
+    static void* run(void* pool);
+    void work();
+    void execute(AsyncJob* job, size_t heap_limit);
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    deque<AsyncJob*> pending;
+    deque<AsyncJob*> done;
+    vector<pthread_t> threads;
+    set<Isolate*> running;
+    bool stopping;
+    int fds[2];
+
+    int time_limit_ms;
+    int cpu_time_limit_ms;
+    int max_young_space_size;
+    int max_old_space_size;
+};
+
+WorkerPool::WorkerPool(int size, int time_limit_ms_, int cpu_time_limit_ms_, int max_young_space_size_, int max_old_space_size_)
+    : stopping(false)
+    , time_limit_ms(time_limit_ms_)
+    , cpu_time_limit_ms(cpu_time_limit_ms_)
+    , max_young_space_size(max_young_space_size_)
+    , max_old_space_size(max_old_space_size_)
+{
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+
+    if (pipe(fds) != 0)
+        croak("Can't create pipe for async results: %s", strerror(errno));
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+    for (int i = 0; i < size; i++) {
+        pthread_t id;
+        if (pthread_create(&id, NULL, run, this) == 0)
+            threads.push_back(id);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    pthread_mutex_lock(&mutex);
+    stopping = true;
+    for (set<Isolate*>::iterator it = running.begin(); it != running.end(); it++)
+        V8::TerminateExecution(*it);
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+
+    for (size_t i = 0; i < threads.size(); i++)
+        pthread_join(threads[i], NULL);
+
+    for (deque<AsyncJob*>::iterator it = pending.begin(); it != pending.end(); it++)
+        delete *it;
+    for (deque<AsyncJob*>::iterator it = done.begin(); it != done.end(); it++)
+        delete *it;
+
+    close(fds[0]);
+    close(fds[1]);
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+}
+
+void WorkerPool::submit(AsyncJob* job) {
+    pthread_mutex_lock(&mutex);
+    pending.push_back(job);
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+}
+
+AsyncJob* WorkerPool::finished() {
+    // Each finished job wrote a byte after being queued
+    char buf[64];
+    while (read(fds[0], buf, sizeof(buf)) > 0);
+
+    AsyncJob* job = NULL;
+    pthread_mutex_lock(&mutex);
+    if (!done.empty()) {
+        job = done.front();
+        done.pop_front();
+    }
+    pthread_mutex_unlock(&mutex);
+    return job;
+}
+
+void WorkerPool::wait() {
+    struct pollfd pfd;
+    pfd.fd = fds[0];
+    pfd.events = POLLIN;
+    while (poll(&pfd, 1, -1) < 0 && errno == EINTR);
+}
+
+void* WorkerPool::run(void* pool) {
+    static_cast<WorkerPool*>(pool)->work();
+    return NULL;
+}
+
+void WorkerPool::work() {
+    Isolate* isolate = Isolate::New();
+
+    {
+        IsolateScope isolate_scope(isolate);
+        bool applied; // always, the isolate is new
+        size_t heap_limit = configure_heap(true, max_young_space_size, max_old_space_size, applied);
+
+        for (;;) {
+            pthread_mutex_lock(&mutex);
+            while (!stopping && pending.empty())
+                pthread_cond_wait(&cond, &mutex);
+            if (stopping) {
+                pthread_mutex_unlock(&mutex);
+                break;
+            }
+            AsyncJob* job = pending.front();
+            pending.pop_front();
+            running.insert(isolate);
+            pthread_mutex_unlock(&mutex);
+
+            execute(job, heap_limit);
+
+            pthread_mutex_lock(&mutex);
+            running.erase(isolate);
+            done.push_back(job);
+            pthread_mutex_unlock(&mutex);
+
+            while (write(fds[1], "", 1) < 0 && errno == EINTR);
+        }
+    }
+
+    isolate->Dispose();
+}
+
+void WorkerPool::execute(AsyncJob* job, size_t heap_limit) {
+    HandleScope handle_scope;
+    Persistent<Context> context = Context::New();
+
+    {
+        Context::Scope context_scope(context);
+        TryCatch try_catch;
+        heap_limiter limiter(heap_limit);
+        thread_canceller canceller(time_limit_ms, cpu_time_limit_ms);
+
+        Handle<Value> val;
+        Handle<Script> script = Script::Compile(
+            String::New(job->source.data(), job->source.size()),
+            String::New("eval")
+        );
+        if (!script.IsEmpty())
+            val = script->Run();
+
+        job->ok = !val.IsEmpty();
+        if (job->ok) {
+            V8Encoder(job->result).encode(val);
+        }
+        else if (const char* reason = limiter.exceeded() ? "heap limit" : canceller.reason()) {
+            job->result = string("Execution terminated: ") + reason + " exceeded\n";
+        }
+        else {
+            job->result = error_message(try_catch);
+        }
+    }
+
+    context.Dispose();
+    V8::ContextDisposedNotification();
+}
+
+// V8Context class starts here
+
+V8Context::V8Context(
+    int time_limit_ms,
+    const char* flags,
+    bool enable_blessing_,
+    const char* bless_prefix_,
+    int script_cache_size,
+    int cpu_time_limit_ms,
+    int max_young_space_size,
+    int max_old_space_size,
+    bool own_isolate,
+    int async_workers,
+    bool lazy_results,
+    bool packed_arrays
+)
+    : isolate(NULL),
+      script_cache(script_cache_size > 0 ? script_cache_size : 0),
+      lazy_results_(lazy_results),
+      packed_arrays_(packed_arrays),
+      time_limit_ms_(time_limit_ms),
+      cpu_time_limit_ms_(cpu_time_limit_ms),
+      heap_limit_(0),
+      max_young_space_size_(max_young_space_size),
+      max_old_space_size_(max_old_space_size),
+      workers(NULL),
+      async_workers_(async_workers),
+      async_id_(0),
+      bless_prefix(bless_prefix_),
+      enable_blessing(enable_blessing_)
+{
+    V8::SetFlagsFromString(flags, strlen(flags));
+
+    if (own_isolate)
+        isolate = Isolate::New();
+
+    IsolateScope isolate_scope(isolate);
+
+    bool applied;
+    heap_limit_ = configure_heap(isolate != NULL, max_young_space_size, max_old_space_size, applied);
+    if (!applied)
+        warn("Heap sizes can't be changed once the heap is set up, use own_isolate");
+
+    context = Context::New();
+
+    Context::Scope context_scope(context);
+    HandleScope handle_scope;
+
+    // Functions instantiated from a FunctionTemplate are never collected, so
+    // bound code refs share one native entry point and are told apart by the
+    // receiver. invoke.apply(holder, arguments) passes the caller's arguments
+    // through without copying them into an array.
+    Local<FunctionTemplate> tmpl = FunctionTemplate::New(PerlFunctionData::v8invoke);
+    Handle<Script> script = Script::Compile(
+        String::New(
+            "(function(invoke) {"
+            "    return function(holder) {"
+            "        return function() {"
+            "            return invoke.apply(holder, arguments)"
+            "        };"
+            "    };"
+            "})"
+        )
+    );
+    Handle<Value> invoke = tmpl->GetFunction();
+    function_factory = Persistent<Function>::New(
+        Handle<Function>::Cast(Handle<Function>::Cast(script->Run())->Call(context->Global(), 1, &invoke))
+    );
+
+    Local<ObjectTemplate> holder = ObjectTemplate::New();
+    holder->SetInternalFieldCount(1);
+    function_holder = Persistent<ObjectTemplate>::New(holder);
+
+    string_wrap = Persistent<String>::New(String::New("wrap"));
+
+    // Taken before any script can replace them
+    Handle<Object> json = context->Global()->Get(String::New("JSON"))->ToObject();
+    json_parse = Persistent<Function>::New(Handle<Function>::Cast(json->Get(String::New("parse"))));
+    json_stringify = Persistent<Function>::New(Handle<Function>::Cast(json->Get(String::New("stringify"))));
+
+    Local<ObjectTemplate> live_array = ObjectTemplate::New();
+    live_array->SetInternalFieldCount(1);
+    live_array->SetIndexedPropertyHandler(
+        live_array_get, live_array_set, live_array_query, live_array_delete, live_array_keys
+    );
+    live_array->SetAccessor(String::New("length"), live_array_length, live_array_set_length,
+        Handle<Value>(), DEFAULT, DontEnum);
+    live_array_template = Persistent<ObjectTemplate>::New(live_array);
+
+    Local<ObjectTemplate> live_hash = ObjectTemplate::New();
+    live_hash->SetInternalFieldCount(1);
+    live_hash->SetNamedPropertyHandler(
+        live_hash_get, live_hash_set, live_hash_query, live_hash_delete, live_hash_keys
+    );
+    live_hash_template = Persistent<ObjectTemplate>::New(live_hash);
+
+    Local<ObjectTemplate> prototype = ObjectTemplate::New();
+    prototype->SetInternalFieldCount(1);
+    prototype->SetNamedPropertyHandler(PerlPrototype::get, 0, PerlPrototype::query);
+    prototype_template = Persistent<ObjectTemplate>::New(prototype);
+
+    number++;
+}
+
+Handle<Object>
+V8Context::make_function(PerlFunctionData* data) {
+    Handle<Object> holder = function_holder->NewInstance();
+    holder->SetPointerInInternalField(0, data);
+    Handle<Value> argv[] = { holder };
+    return Handle<Object>::Cast(function_factory->Call(context->Global(), 1, argv));
+}
+
+void V8Context::register_object(ObjectData* data) {
+    seen_perl[data->ptr] = data;
+    data->object->SetHiddenValue(string_wrap, External::Wrap(data));
+}
+
+void V8Context::remove_object(ObjectData* data) {
+    ObjectDataMap::iterator it = seen_perl.find(data->ptr);
+    if (it != seen_perl.end() && it->second == data)
+        seen_perl.erase(it);
+    data->object->DeleteHiddenValue(string_wrap);
+}
+
+V8Context::~V8Context() {
+    delete workers;
+    for (AsyncCallbackMap::iterator it = async_callbacks.begin(); it != async_callbacks.end(); it++)
+        SvREFCNT_dec(it->second);
+
+    {
+        IsolateScope isolate_scope(isolate);
+
+        for (ObjectDataMap::iterator it = seen_perl.begin(); it != seen_perl.end(); it++) {
+            // Whether or not the object outlives us, the scalar is the caller's again
+            if (PerlBufferData *buffer = dynamic_cast<PerlBufferData*>(it->second)) {
+                HandleScope handle_scope;
+                Context::Scope context_scope(context);
+                buffer->unbind();
+            }
+            it->second->context = NULL;
+            if (isolate)
+                it->second->release();
+        }
+        seen_perl.clear();
+
+        for (PackedArraySet::iterator it = packed.begin(); it != packed.end(); ) {
+            PackedArrayData *data = *it++;
+            data->context = NULL;
+            if (isolate)
+                delete data;
+        }
+        packed.clear();
+
+        // Scripts can outlive us on the Perl side; their handles can't.
+        for (ScriptSet::iterator it = scripts.begin(); it != scripts.end(); it++) {
+            (*it)->script.Dispose();
+            (*it)->context = NULL;
+        }
+        scripts.clear();
+
+        for (ProxySet::iterator it = proxies.begin(); it != proxies.end(); it++) {
+            (*it)->object.Dispose();
+            (*it)->keys.Dispose();
+            (*it)->context = NULL;
+        }
+        proxies.clear();
+
+        for (size_t i = 0; i < prototypes.capacity(); i++)
+            delete prototypes.at(i).prototype;
+        prototypes.clear();
+        function_factory.Dispose();
+        function_holder.Dispose();
+        live_array_template.Dispose();
+        live_hash_template.Dispose();
+        prototype_template.Dispose();
+        json_parse.Dispose();
+        json_stringify.Dispose();
+        script_cache.clear();
+        for (CodeCacheMap::iterator it = code_caches.begin(); it != code_caches.end(); it++)
+            delete it->second;
+        context.Dispose();
+        while(!V8::IdleNotification()); // force garbage collection
+    }
+
+    if (isolate)
+        isolate->Dispose();
+}
+
+void
+V8Context::bind(const char *name, SV *thing) {
+    IsolateScope isolate_scope(isolate);
+    HandleScope scope;
+    Context::Scope context_scope(context);
+
+    context->Global()->Set(String::New(name), sv2v8(thing));
+}
+
+void
+V8Context::bind_ro(const char *name, SV *thing) {
+    IsolateScope isolate_scope(isolate);
+    HandleScope scope;
+    Context::Scope context_scope(context);
+
+    context->Global()->ForceSet(String::New(name), sv2v8(thing),
+        v8::PropertyAttribute(v8::ReadOnly | v8::DontDelete));
+}
+
+void
+V8Context::bind_live(const char *name, SV *ref) {
+    if (!SvROK(ref) || SvOBJECT(SvRV(ref))
+        || (SvTYPE(SvRV(ref)) != SVt_PVAV && SvTYPE(SvRV(ref)) != SVt_PVHV))
+        croak("bind_live() needs an unblessed array or hash reference");
+
+    IsolateScope isolate_scope(isolate);
+    HandleScope scope;
+    Context::Scope context_scope(context);
+
+    context->Global()->Set(String::New(name), live2v8(ref));
+}
+
+void
+V8Context::transfer(const char *name, SV *data) {
+    string buf;
+    SvEncoder(buf).encode(data);
+
+    IsolateScope isolate_scope(isolate);
+    HandleScope scope;
+    Context::Scope context_scope(context);
+
+    context->Global()->Set(String::New(name), V8Decoder(buf).decode());
+}
+
+SV*
+V8Context::export_value(const char *name) {
+    string buf;
+
+    {
+        IsolateScope isolate_scope(isolate);
+        HandleScope scope;
+        Context::Scope context_scope(context);
+
+        V8Encoder(buf).encode(context->Global()->Get(String::New(name)));
+    }
+
+    return SvDecoder(buf).decode();
+}
+
+void
+V8Context::bind_json(const char *name, SV *json) {
+    bool die = false;
+
+    {
+        IsolateScope isolate_scope(isolate);
+        HandleScope scope;
+        TryCatch try_catch;
+        Context::Scope context_scope(context);
+
+        Handle<Value> str = sv2v8str(json);
+        Handle<Value> value = json_parse->Call(context->Global(), 1, &str);
+
+        if (value.IsEmpty()) {
+            set_perl_error(try_catch);
+            die = true;
+        }
+        else {
+            context->Global()->Set(String::New(name), value);
+        }
+    }
+
+    if (die)
+        croak(NULL);
+}
+
+void
+V8Context::bind_buffer(const char *name, SV *ref) {
+    if (!SvROK(ref) || SvROK(SvRV(ref)) || SvTYPE(SvRV(ref)) >= SVt_PVAV)
+        croak("bind_buffer() needs a scalar reference");
+
+    // Anything that can die happens before entering V8, a scalar bound
+    // already is read-only until V8 lets go of it
+    SV *sv = SvRV(ref);
+    if (seen_perl.find(PTR2IV(sv)) == seen_perl.end()) {
+        if (SvREADONLY(sv))
+            croak("bind_buffer() needs a writable scalar");
+        if (SvUTF8(sv) && !sv_utf8_downgrade(sv, TRUE))
+            croak("Wide character in bind_buffer()");
+        SvPV_force_nolen(sv);
+    }
+
+    IsolateScope isolate_scope(isolate);
+    HandleScope scope;
+    Context::Scope context_scope(context);
+
+    context->Global()->Set(String::New(name), buffer2object(sv));
+}
+
+void
+V8Context::unbind_buffer(SV *ref) {
+    if (!SvROK(ref))
+        croak("unbind_buffer() needs a scalar reference");
+
+    ObjectDataMap::iterator it = seen_perl.find(PTR2IV(SvRV(ref)));
+    if (it == seen_perl.end())
+        return;
+
+    PerlBufferData *buffer = dynamic_cast<PerlBufferData*>(it->second);
+    if (!buffer)
+        return;
+
+    IsolateScope isolate_scope(isolate);
+    HandleScope scope;
+    Context::Scope context_scope(context);
+
+    buffer->unbind();
+    remove_object(buffer);
+}
+
+void V8Context::name_global(const char *name) {
+    IsolateScope isolate_scope(isolate);
+    HandleScope scope;
+    Context::Scope context_scope(context);
+
+    context->Global()->ForceSet(String::New(name), context->Global(),
+        v8::PropertyAttribute(v8::ReadOnly | v8::DontDelete));
+}
+
+SV*
+V8Context::eval(SV* source, SV* origin) {
+    IsolateScope isolate_scope(isolate);
+    HandleScope handle_scope;
+    TryCatch try_catch;
+    Context::Scope context_scope(context);
+
+    // V8 expects everything in UTF-8, ensure SVs are upgraded.
+    sv_utf8_upgrade(source);
+    Handle<Script> script = compile_script(source, origin);
+
+    if (try_catch.HasCaught()) {
+        set_perl_error(try_catch);
+        return &PL_sv_undef;
+    }
+
+    return run(script, try_catch);
+}
+
+SV*
+V8Context::eval_json(SV* source, SV* origin) {
+    IsolateScope isolate_scope(isolate);
+    HandleScope handle_scope;
+    TryCatch try_catch;
+    Context::Scope context_scope(context);
+
+    sv_utf8_upgrade(source);
+    Handle<Script> script = compile_script(source, origin);
+
+    if (try_catch.HasCaught()) {
+        set_perl_error(try_catch);
+        return &PL_sv_undef;
+    }
+
+    return run(script, try_catch, true);
+}
+
+SV*
+V8Context::run(Handle<Script> script, TryCatch& try_catch, bool json) {
+    heap_limiter limiter(heap_limit_);
+    thread_canceller canceller(time_limit_ms_, cpu_time_limit_ms_);
+    Handle<Value> val = script->Run();
+
+    // Stringified while the limits still apply, it may be big
+    if (json && !val.IsEmpty())
+        val = json_stringify->Call(context->Global(), 1, &val);
+
+    if (val.IsEmpty()) {
+        const char* reason = limiter.exceeded() ? "heap limit" : canceller.reason();
+        if (reason)
+            sv_setpvf(ERRSV, "Execution terminated: %s exceeded\n", reason);
+        else
+            set_perl_error(try_catch);
+        return &PL_sv_undef;
+    } else {
+        sv_setsv(ERRSV,&PL_sv_undef);
+        if (GIMME_V == G_VOID) {
+            return &PL_sv_undef;
+        }
+        if (json)
+            return val->IsString() ? string2sv(Handle<String>::Cast(val)) : &PL_sv_undef;
+        return lazy_results_ ? lazy2sv(val) : v82sv(val);
+    }
+}
+
+void
+V8Context::eval_async(SV* source, SV* callback) {
+    if (!workers)
+        workers = new WorkerPool(async_workers_, time_limit_ms_, cpu_time_limit_ms_,
+            max_young_space_size_, max_old_space_size_);
+
+    AsyncJob* job = new AsyncJob;
+    job->id = ++async_id_;
+
+    STRLEN len;
+    const char* str = SvPVutf8(source, len);
+    job->source.assign(str, len);
+
+    async_callbacks[job->id] = newSVsv(callback);
+    workers->submit(job);
+}
+
+int
+V8Context::async_fd() {
+    if (!workers)
+        workers = new WorkerPool(async_workers_, time_limit_ms_, cpu_time_limit_ms_,
+            max_young_space_size_, max_old_space_size_);
+
+    return workers->fd();
+}
+
+int
+V8Context::async_poll(bool block) {
+    if (!workers)
+        return 0;
+
+    if (block && !async_callbacks.empty())
+        workers->wait();
+
+    int count = 0;
+    SV* first_error = NULL;
+    while (AsyncJob* job = workers->finished()) {
+        AsyncCallbackMap::iterator it = async_callbacks.find(job->id);
+        if (it == async_callbacks.end()) {
+            delete job;
+            continue;
+        }
+        SV* callback = sv_2mortal(it->second);
+        async_callbacks.erase(it);
+
+        SV* result = &PL_sv_undef;
+        SV* error = &PL_sv_undef;
+        if (job->ok) {
+            result = sv_2mortal(SvDecoder(job->result).decode());
+        }
+        else {
+            error = sv_2mortal(newSVpvn(job->result.data(), job->result.size()));
+            sv_utf8_upgrade(error);
+        }
+        delete job;
+
+        // The wakeups of all finished jobs are read already, so the other
+        // callbacks run before the first error propagates to our caller
+        dSP;
+        ENTER;
+        SAVETMPS;
+        PUSHMARK(SP);
+        XPUSHs(result);
+        XPUSHs(error);
+        PUTBACK;
+        call_sv(callback, G_DISCARD | G_EVAL);
+        if (SvTRUE(ERRSV) && !first_error)
+            first_error = newSVsv(ERRSV);
+        FREETMPS;
+        LEAVE;
+
+        count++;
+    }
+
+    if (first_error) {
+        sv_setsv(ERRSV, sv_2mortal(first_error));
+        croak(NULL);
+    }
+
+    return count;
+}
+
+V8Script*
+V8Context::compile(SV* source, SV* origin) {
+    IsolateScope isolate_scope(isolate);
+    HandleScope handle_scope;
+    TryCatch try_catch;
+    Context::Scope context_scope(context);
+
+    // V8 expects everything in UTF-8, ensure SVs are upgraded.
+    sv_utf8_upgrade(source);
+    Handle<Script> script = compile_uncached(source, origin);
+
+    if (try_catch.HasCaught()) {
+        set_perl_error(try_catch);
+        return NULL;
+    }
+
+    sv_setsv(ERRSV,&PL_sv_undef);
+    return new V8Script(this, script);
+}
+
+void V8Context::register_script(V8Script* script) {
+    scripts.insert(script);
+}
+
+void V8Context::remove_script(V8Script* script) {
+    scripts.erase(script);
+}
+
+V8Script::V8Script(V8Context* context_, Handle<Script> script_)
+    : context(context_)
+    , script(Persistent<Script>::New(script_))
+{
+    context->register_script(this);
+}
+
+V8Script::~V8Script() {
+    if (context) {
+        IsolateScope isolate_scope(context->isolate);
+        context->remove_script(this);
+        script.Dispose();
+    }
+}
+
+SV*
+V8Script::run() {
+    if (!context)
+        croak("Fatal error: V8 context is no more");
+
+    IsolateScope isolate_scope(context->isolate);
+    HandleScope handle_scope;
+    TryCatch try_catch;
+    Context::Scope context_scope(context->context);
+
+    return context->run(script, try_catch);
 }
 
-size_t PerlMethodData::size() {
-    return sizeof(PerlMethodData);
+void V8Context::register_proxy(V8Proxy* proxy) {
+    proxies.insert(proxy);
 }
 
-// V8Context class starts here
+void V8Context::remove_proxy(V8Proxy* proxy) {
+    proxies.erase(proxy);
+}
 
-V8Context::V8Context(
-    int time_limit,
-    const char* flags,
-    bool enable_blessing_,
-    const char* bless_prefix_
-)
-    : time_limit_(time_limit),
-      bless_prefix(bless_prefix_),
-      enable_blessing(enable_blessing_)
-{
-    V8::SetFlagsFromString(flags, strlen(flags));
-    context = Context::New();
+// Arrays and plain objects become tied containers, everything else is
+// converted as usual. Expects to be called inside the context.
+SV*
+V8Context::lazy2sv(Handle<Value> value) {
+    if (!value->IsObject() || value->IsFunction())
+        return v82sv(value);
 
-    Context::Scope context_scope(context);
-    HandleScope handle_scope;
+    Handle<Object> object = value->ToObject();
 
-    Local<FunctionTemplate> tmpl = FunctionTemplate::New(PerlFunctionData::v8invoke);
-    context->Global()->Set(
-        String::New("__perlFunctionWrapper"),
-        tmpl->GetFunction()
-    );
+    if (SV *cached = seen_v8(object))
+        return cached;
 
-    Handle<Script> script = Script::Compile(
-        String::New(
-            "(function(wrap) {"
-            "    return function() {"
-            "        var args = Array.prototype.slice.call(arguments);"
-            "        args.unshift(wrap);"
-            "        return __perlFunctionWrapper.apply(this, args)"
-            "    };"
-            "})"
-        )
-    );
-    make_function = Persistent<Function>::New(Handle<Function>::Cast(script->Run()));
+    if (enable_blessing && object->Has(String::New("__perlPackage")))
+        return object2blessed(object);
 
-    string_wrap = Persistent<String>::New(String::New("wrap"));
+    bool array = value->IsArray();
+    SV *container = array ? (SV*)newAV() : (SV*)newHV();
+    SV *tie = newSV(0);
+    sv_setref_pv(tie, "JavaScript::V8::Proxy", new V8Proxy(this, object));
+    sv_magic(container, tie, PERL_MAGIC_tied, NULL, 0);
+    SvREFCNT_dec(tie); // sv_magic holds its own reference
 
-    number++;
+    return newRV_noinc(container);
 }
 
-void V8Context::register_object(ObjectData* data) {
-    seen_perl[data->ptr] = data;
-    data->object->SetHiddenValue(string_wrap, External::Wrap(data));
+V8Proxy::V8Proxy(V8Context* context_, Handle<Object> object_)
+    : context(context_)
+    , object(Persistent<Object>::New(object_))
+    , next_key(0)
+    , cache(object_->IsArray() ? (SV*)newAV() : (SV*)newHV())
+{
+    context->register_proxy(this);
 }
 
-void V8Context::remove_object(ObjectData* data) {
-    ObjectDataMap::iterator it = seen_perl.find(data->ptr);
-    if (it != seen_perl.end())
-        seen_perl.erase(it);
-    data->object->DeleteHiddenValue(string_wrap);
+V8Proxy::~V8Proxy() {
+    if (context) {
+        IsolateScope isolate_scope(context->isolate);
+        context->remove_proxy(this);
+        object.Dispose();
+        keys.Dispose();
+    }
+    SvREFCNT_dec(cache);
 }
 
-V8Context::~V8Context() {
-    for (ObjectDataMap::iterator it = seen_perl.begin(); it != seen_perl.end(); it++) {
-        it->second->context = NULL;
-    }
-    seen_perl.clear();
+#define SETUP_PROXY_CALL \
+    if (!context) \
+        croak("Fatal error: V8 context is no more"); \
+\
+    IsolateScope isolate_scope(context->isolate); \
+    HandleScope handle_scope; \
+    Context::Scope context_scope(context->context);
+
+SV*
+V8Proxy::fetch(SV* key) {
+    SV **cached = NULL;
+    if (SvTYPE(cache) == SVt_PVAV)
+        cached = av_fetch((AV*)cache, SvIV(key), 0);
+    else if (HE *he = hv_fetch_ent((HV*)cache, key, 0, 0))
+        cached = &HeVAL(he);
+
+    if (cached)
+        return SvREFCNT_inc(*cached);
+
+    bool die = false;
+    SV *sv = NULL;
+
+    {
+        SETUP_PROXY_CALL
+        TryCatch try_catch;
+
+        Handle<Value> value = SvTYPE(cache) == SVt_PVAV
+            ? object->Get(SvIV(key))
+            : object->Get(context->sv2v8(key));
 
-    for (ObjectMap::iterator it = prototypes.begin(); it != prototypes.end(); it++) {
-      it->second.Dispose();
+        if (try_catch.HasCaught()) {
+            set_perl_error(try_catch);
+            die = true;
+        }
+        else {
+            sv = context->lazy2sv(value);
+        }
     }
-    context.Dispose();
-    while(!V8::IdleNotification()); // force garbage collection
-}
 
-void
-V8Context::bind(const char *name, SV *thing) {
-    HandleScope scope;
-    Context::Scope context_scope(context);
+    if (die)
+        croak(NULL);
 
-    context->Global()->Set(String::New(name), sv2v8(thing));
+    if (SvTYPE(cache) == SVt_PVAV)
+        av_store((AV*)cache, SvIV(key), sv);
+    else
+        hv_store_ent((HV*)cache, key, sv, 0);
+
+    return SvREFCNT_inc(sv);
 }
 
-void
-V8Context::bind_ro(const char *name, SV *thing) {
-    HandleScope scope;
-    Context::Scope context_scope(context);
+bool
+V8Proxy::exists(SV* key) {
+    SETUP_PROXY_CALL
 
-    context->Global()->ForceSet(String::New(name), sv2v8(thing),
-        v8::PropertyAttribute(v8::ReadOnly | v8::DontDelete));
+    if (SvTYPE(cache) == SVt_PVAV)
+        return object->Has(SvIV(key));
+
+    return object->Has(context->sv2v8(key)->ToString());
 }
 
-void V8Context::name_global(const char *name) {
-    HandleScope scope;
-    Context::Scope context_scope(context);
+int
+V8Proxy::fetchsize() {
+    SETUP_PROXY_CALL
+    return Handle<Array>::Cast(object)->Length();
+}
 
-    context->Global()->ForceSet(String::New(name), context->Global(),
-        v8::PropertyAttribute(v8::ReadOnly | v8::DontDelete));
+int
+V8Proxy::scalar() {
+    SETUP_PROXY_CALL
+    return object->GetPropertyNames()->Length();
 }
 
-// I fucking hate pthreads, this lacks error handling, but hopefully works.
-class thread_canceller {
-public:
-    thread_canceller(int sec)
-        : sec_(sec)
+SV*
+V8Proxy::firstkey() {
     {
-        if (sec_) {
-            pthread_cond_init(&cond_, NULL);
-            pthread_mutex_init(&mutex_, NULL);
-            pthread_mutex_lock(&mutex_); // passed locked to canceller
-            pthread_create(&id_, NULL, canceller, this);
-        }
+        SETUP_PROXY_CALL
+        keys.Dispose();
+        keys = Persistent<Array>::New(object->GetPropertyNames());
+        next_key = 0;
     }
+    return nextkey();
+}
 
-    ~thread_canceller() {
-        if (sec_) {
-            pthread_mutex_lock(&mutex_);
-            pthread_cond_signal(&cond_);
-            pthread_mutex_unlock(&mutex_);
-            void *ret;
-            pthread_join(id_, &ret);
-            pthread_mutex_destroy(&mutex_);
-            pthread_cond_destroy(&cond_);
-        }
+SV*
+V8Proxy::nextkey(SV* lastkey) {
+    SETUP_PROXY_CALL
+
+    if (keys.IsEmpty() || next_key >= keys->Length())
+        return &PL_sv_undef;
+
+    return context->v82sv(keys->Get(next_key++)->ToString());
+}
+
+Handle<Script>
+V8Context::compile_script(SV* source, SV* origin) {
+    if (!script_cache.capacity())
+        return compile_uncached(source, origin);
+
+    STRLEN len;
+    const char* str = SvPVutf8(source, len);
+    string source_key(str, len);
+    string origin_key("eval");
+    if (origin) {
+        str = SvPVutf8(origin, len);
+        origin_key.assign(str, len);
     }
 
-private:
+    Handle<Script> script = script_cache.find(source_key, origin_key);
+    if (!script.IsEmpty())
+        return script;
 
-    static void* canceller(void* this_) {
-        thread_canceller* me = static_cast<thread_canceller*>(this_);
-        struct timeval tv;
-        struct timespec ts;
-        gettimeofday(&tv, NULL);
-        ts.tv_sec = tv.tv_sec + me->sec_;
-        ts.tv_nsec = tv.tv_usec * 1000;
+    script = compile_uncached(source, origin);
+    if (!script.IsEmpty())
+        script_cache.add(source_key, origin_key, script);
 
-        if (pthread_cond_timedwait(&me->cond_, &me->mutex_, &ts) == ETIMEDOUT) {
-            V8::TerminateExecution();
-        }
-        pthread_mutex_unlock(&me->mutex_);
-        return NULL;
+    return script;
+}
+
+Handle<Script>
+V8Context::compile_uncached(SV* source, SV* origin) {
+    ScriptOrigin script_origin(origin ? sv2v8str(origin) : String::New("eval"));
+    ScriptData* pre_data = NULL;
+
+    if (!code_caches.empty()) {
+        STRLEN len;
+        const char* str = SvPVutf8(source, len);
+        pre_data = find_code_cache(str, len);
     }
 
-    pthread_t id_;
-    pthread_cond_t cond_;
-    pthread_mutex_t mutex_;
-    int sec_;
-};
+    return Script::Compile(sv2v8str(source), &script_origin, pre_data);
+}
+
+ScriptData*
+V8Context::find_code_cache(const char* source, size_t length) {
+    size_t hash = hash_bytes(source, length);
+
+    pair<CodeCacheMap::iterator, CodeCacheMap::iterator> range = code_caches.equal_range(hash);
+    for (CodeCacheMap::iterator it = range.first; it != range.second; it++)
+        if (it->second->source.compare(0, string::npos, source, length) == 0)
+            return it->second->data;
+
+    return NULL;
+}
 
 SV*
-V8Context::eval(SV* source, SV* origin) {
+V8Context::create_code_cache(SV* source) {
+    IsolateScope isolate_scope(isolate);
     HandleScope handle_scope;
     TryCatch try_catch;
     Context::Scope context_scope(context);
 
-    // V8 expects everything in UTF-8, ensure SVs are upgraded.
+    // Compile once so syntax errors are reported like eval() does.
     sv_utf8_upgrade(source);
-    Handle<Script> script = Script::Compile(
-        sv2v8str(source),
-        origin ? sv2v8str(origin) : String::New("eval")
-    );
+    Handle<String> str = sv2v8str(source);
+    Script::New(str);
 
     if (try_catch.HasCaught()) {
         set_perl_error(try_catch);
         return &PL_sv_undef;
-    } else {
-        thread_canceller canceller(time_limit_);
-        Handle<Value> val = script->Run();
+    }
 
-        if (val.IsEmpty()) {
-            set_perl_error(try_catch);
-            return &PL_sv_undef;
-        } else {
-            sv_setsv(ERRSV,&PL_sv_undef);
-            if (GIMME_V == G_VOID) {
-                return &PL_sv_undef;
-            }
-            return v82sv(val);
+    ScriptData* data = ScriptData::PreCompile(str);
+    SV* sv = data->HasError() ? &PL_sv_undef : newSVpvn(data->Data(), data->Length());
+    delete data;
+
+    sv_setsv(ERRSV,&PL_sv_undef);
+    return sv;
+}
+
+bool
+V8Context::load_code_cache(SV* source, SV* cache) {
+    STRLEN len;
+    const char* str = SvPVutf8(source, len);
+    string key(str, len);
+
+    // The entry keeps its own copy, the scalar may be gone by the next compile
+    str = SvPVbyte(cache, len);
+    CodeCacheEntry* entry = new CodeCacheEntry(key, str, len);
+    if (entry->data->HasError()) {
+        delete entry;
+        return false;
+    }
+
+    size_t hash = hash_bytes(key.data(), key.size());
+
+    pair<CodeCacheMap::iterator, CodeCacheMap::iterator> range = code_caches.equal_range(hash);
+    for (CodeCacheMap::iterator it = range.first; it != range.second; it++) {
+        if (it->second->source == key) {
+            delete it->second;
+            code_caches.erase(it);
+            break;
         }
     }
+
+    code_caches.insert(pair<size_t, CodeCacheEntry*>(hash, entry));
+    return true;
+}
+
+SV*
+V8Context::script_cache_stats() {
+    HV *hv = newHV();
+
+    hv_store(hv, "hits", 4, newSViv(script_cache.hits), 0);
+    hv_store(hv, "misses", 6, newSViv(script_cache.misses), 0);
+    hv_store(hv, "entries", 7, newSViv(script_cache.size()), 0);
+    hv_store(hv, "capacity", 8, newSViv(script_cache.capacity()), 0);
+
+    return newRV_noinc((SV*)hv);
 }
 
 Handle<Value>
 V8Context::sv2v8(SV *sv, HandleMap& seen) {
     if (SvROK(sv))
         return rv2v8(sv, seen);
-    if (SvPOK(sv)) {
-        // Upgrade string to UTF-8 if needed
-        char *utf8 = SvPVutf8_nolen(sv);
-        return String::New(utf8, SvCUR(sv));
-    }
+    if (SvPOK(sv))
+        return sv2v8str(sv);
     if (SvIOK(sv)) {
         IV v = SvIV(sv);
         return (v <= INT32_MAX && v >= INT32_MIN) ? (Handle<Number>)Integer::New(v) : Number::New(SvNV(sv));
@@ -488,15 +2735,22 @@ V8Context::sv2v8(SV *sv, HandleMap& seen) {
 
 Handle<Value>
 V8Context::sv2v8(SV *sv) {
-    HandleMap seen;
+    HandleMap seen(&handle_arena);
     return sv2v8(sv, seen);
 }
 
 Handle<String> V8Context::sv2v8str(SV* sv)
 {
+    STRLEN len;
+    const char *str = SvPV(sv, len);
+
+    // Big ASCII strings are shared with V8 rather than copied into its heap
+    if (len >= EXTERNAL_STRING_MIN_LENGTH && is_ascii(str, len))
+        return String::NewExternal(new SvExternalString(sv));
+
     // Upgrade string to UTF-8 if needed
-    char *utf8 = SvPVutf8_nolen(sv);
-    return String::New(utf8, SvCUR(sv));
+    char *utf8 = SvPVutf8(sv, len);
+    return String::New(utf8, len);
 }
 
 SV* V8Context::seen_v8(Handle<Object> object) {
@@ -508,8 +2762,9 @@ SV* V8Context::seen_v8(Handle<Object> object) {
     return newRV(data->sv);
 }
 
+// Returns NULL for anything which may need cycle tracking
 SV *
-V8Context::v82sv(Handle<Value> value, SvMap& seen) {
+V8Context::primitive2sv(Handle<Value> value) {
     if (value->IsUndefined())
         return &PL_sv_undef;
 
@@ -525,12 +2780,16 @@ V8Context::v82sv(Handle<Value> value, SvMap& seen) {
     if (value->IsNumber())
         return newSVnv(value->NumberValue());
 
-    if (value->IsString()) {
-        String::Utf8Value str(value);
-        SV *sv = newSVpvn(*str, str.length());
-        sv_utf8_decode(sv);
+    if (value->IsString())
+        return string2sv(Handle<String>::Cast(value));
+
+    return NULL;
+}
+
+SV *
+V8Context::v82sv(Handle<Value> value, SvMap& seen) {
+    if (SV *sv = primitive2sv(value))
         return sv;
-    }
 
     if (value->IsArray() || value->IsObject() || value->IsFunction()) {
         Handle<Object> object = value->ToObject();
@@ -546,6 +2805,17 @@ V8Context::v82sv(Handle<Value> value, SvMap& seen) {
         if (SV* cached = seen.find(object))
             return cached;
 
+        if (object->HasIndexedPropertiesInExternalArrayData()) {
+            switch (object->GetIndexedPropertiesExternalArrayDataType()) {
+                case kExternalByteArray:
+                case kExternalUnsignedByteArray:
+                case kExternalPixelArray:
+                    return bytes2sv(object);
+                default:
+                    return numbers2sv(object);
+            }
+        }
+
         if (value->IsArray()) {
             Handle<Array> array = Handle<Array>::Cast(value);
             return array2sv(array, seen);
@@ -563,52 +2833,45 @@ V8Context::v82sv(Handle<Value> value, SvMap& seen) {
 
 SV *
 V8Context::v82sv(Handle<Value> value) {
-    SvMap seen;
+    if (SV *sv = primitive2sv(value))
+        return sv;
+
+    SvMap seen(&sv_arena);
     return v82sv(value, seen);
 }
 
-void
-V8Context::fill_prototype(Handle<Object> prototype, HV* stash) {
-    HE *he;
-    while (he = hv_iternext(stash)) {
-        SV *key = HeSVKEY_force(he);
-        Local<String> name = String::New(SvPV_nolen(key));
-
-        if (prototype->Has(name))
-            continue;
-
-        prototype->Set(name, (new PerlMethodData(this, SvPV_nolen(key)))->object);
-    }
+SV *
+V8Context::string2sv(Handle<String> str) {
+    int len = str->Utf8Length();
+    if (!len)
+        return newSVpvn("", 0);
+
+    // Write straight into the SV buffer, V8 already knows the encoded length
+    SV *sv = newSV(len);
+    char *buf = SvPVX(sv);
+    str->WriteUtf8(buf, len, NULL, String::NO_NULL_TERMINATION);
+    buf[len] = '\0';
+    SvCUR_set(sv, len);
+    SvPOK_on(sv);
+
+    // Only non-ASCII characters take more than one byte in UTF-8
+    if (len != str->Length())
+        SvUTF8_on(sv);
+
+    return sv;
 }
 
 #if PERL_VERSION > 8
 Handle<Object>
 V8Context::get_prototype(SV *sv) {
     HV *stash = SvSTASH(sv);
-    char *package = HvNAME(stash);
-
-    std::string pkg(package);
-    ObjectMap::iterator it;
-
-    Persistent<Object> prototype;
-
-    it = prototypes.find(pkg);
-    if (it != prototypes.end()) {
-        prototype = it->second;
-    }
-    else {
-        prototype = prototypes[pkg] = Persistent<Object>::New(Object::New());
 
-        if (AV *isa = mro_get_linear_isa(stash)) {
-            for (int i = 0; i <= av_len(isa); i++) {
-                SV **sv = av_fetch(isa, i, 0);
-                HV *stash = gv_stashsv(*sv, 0);
-                fill_prototype(prototype, stash);
-            }
-        }
-    }
+    if (PerlPrototype *prototype = prototypes.find(stash))
+        return prototype->object;
 
-    return prototype;
+    PerlPrototype *prototype = new PerlPrototype(this, stash, prototype_template->NewInstance());
+    prototypes.add(stash, prototype);
+    return prototype->object;
 }
 #endif
 
@@ -624,9 +2887,9 @@ V8Context::rv2v8(SV *rv, HandleMap& seen) {
     }
 
     {
-        HandleMap::const_iterator it = seen.find(ptr);
-        if (it != seen.end())
-            return it->second;
+        Handle<Value> value = seen.find(sv);
+        if (!value.IsEmpty())
+            return value;
     }
 
 #if PERL_VERSION > 8
@@ -636,11 +2899,19 @@ V8Context::rv2v8(SV *rv, HandleMap& seen) {
 
     unsigned t = SvTYPE(sv);
 
-    if (t == SVt_PVAV)
-        return av2array((AV*)sv, seen, ptr);
+    if (t == SVt_PVAV) {
+        if (packed_arrays_) {
+            Handle<Object> array = av2packed((AV*)sv);
+            if (!array.IsEmpty()) {
+                seen.add(sv, array);
+                return array;
+            }
+        }
+        return av2array((AV*)sv, seen);
+    }
 
     if (t == SVt_PVHV)
-        return hv2object((HV*)sv, seen, ptr);
+        return hv2object((HV*)sv, seen);
 
     if (t == SVt_PVCV)
         return cv2function((CV*)sv);
@@ -660,10 +2931,10 @@ V8Context::blessed2object(SV *sv) {
 #endif
 
 Handle<Array>
-V8Context::av2array(AV *av, HandleMap& seen, long ptr) {
+V8Context::av2array(AV *av, HandleMap& seen) {
     I32 i, len = av_len(av) + 1;
     Handle<Array> array = Array::New(len);
-    seen[ptr] = array;
+    seen.add((SV*)av, array);
     for (i = 0; i < len; i++) {
         if (SV** sv = av_fetch(av, i, 0)) {
             array->Set(Integer::New(i), sv2v8(*sv, seen));
@@ -673,37 +2944,210 @@ V8Context::av2array(AV *av, HandleMap& seen, long ptr) {
 }
 
 Handle<Object>
-V8Context::hv2object(HV *hv, HandleMap& seen, long ptr) {
+V8Context::hv2object(HV *hv, HandleMap& seen) {
     I32 len;
     char *key;
     SV *val;
 
     hv_iterinit(hv);
     Handle<Object> object = Object::New();
-    seen[ptr] = object;
+    seen.add((SV*)hv, object);
     while (val = hv_iternextsv(hv, &key, &len)) {
         object->Set(String::New(key, len), sv2v8(val, seen));
     }
     return object;
 }
 
+Handle<Object>
+V8Context::buffer2object(SV *sv) {
+    ObjectDataMap::iterator it = seen_perl.find(PTR2IV(sv));
+    if (it != seen_perl.end())
+        return it->second->object;
+
+    char *buf = SvPVX(sv);
+    STRLEN len = SvCUR(sv);
+
+    Handle<Object> object = Object::New();
+    object->SetIndexedPropertiesToExternalArrayData(buf, kExternalUnsignedByteArray, len);
+
+    PropertyAttribute attributes = PropertyAttribute(ReadOnly | DontEnum | DontDelete);
+    object->ForceSet(String::New("length"), Integer::New(len), attributes);
+    object->ForceSet(String::New("byteLength"), Integer::New(len), attributes);
+
+    return (new PerlBufferData(this, object, sv))->object;
+}
+
+// Byte arrays, typed arrays included, come back as byte strings
+SV*
+V8Context::bytes2sv(Handle<Object> object) {
+    int len = object->GetIndexedPropertiesExternalArrayDataLength();
+    return newSVpvn((const char*)object->GetIndexedPropertiesExternalArrayData(), len);
+}
+
+PackedArrayData::PackedArrayData(V8Context* context_, Handle<Object> object_, void* data_, size_t bytes_)
+    : context(context_)
+    , object(Persistent<Object>::New(object_))
+    , data(data_)
+    , bytes(bytes_)
+{
+    context->packed.insert(this);
+    V8::AdjustAmountOfExternalAllocatedMemory(bytes);
+    object.MakeWeak(this, PackedArrayData::destroy);
+}
+
+PackedArrayData::~PackedArrayData() {
+    if (context)
+        context->packed.erase(this);
+    object.Dispose();
+    V8::AdjustAmountOfExternalAllocatedMemory(-(int)bytes);
+    free(data);
+}
+
+void PackedArrayData::destroy(Persistent<Value> object, void *data) {
+    delete static_cast<PackedArrayData*>(data);
+}
+
+// Shorter arrays are not worth a separate allocation
+#define PACKED_ARRAY_MIN_LENGTH 16
+
+// Arrays of nothing but numbers become an object with the numbers stored
+// as double external array data, filled in one pass. Doubles even for
+// integers, int32 elements would truncate what scripts write into them.
+// Returns an empty handle for anything else.
+Handle<Object>
+V8Context::av2packed(AV *av) {
+    I32 len = av_len(av) + 1;
+    if (len < PACKED_ARRAY_MIN_LENGTH || SvRMAGICAL((SV*)av))
+        return Handle<Object>();
+
+    SV **items = AvARRAY(av);
+
+    // Same precedence as sv2v8(): strings stay strings
+    for (I32 i = 0; i < len; i++) {
+        SV *sv = items[i];
+        if (!sv || SvROK(sv) || SvPOK(sv) || SvGMAGICAL(sv) || !(SvIOK(sv) || SvNOK(sv)))
+            return Handle<Object>();
+    }
+
+    size_t bytes = len * sizeof(double);
+    double *data = (double*)malloc(bytes);
+    for (I32 i = 0; i < len; i++)
+        data[i] = SvNV(items[i]);
+
+    Handle<Object> object = Object::New();
+    object->SetIndexedPropertiesToExternalArrayData(data, kExternalDoubleArray, len);
+    object->SetPrototype(
+        context->Global()->Get(String::New("Array"))->ToObject()->Get(String::New("prototype"))
+    );
+    object->ForceSet(String::New("length"), Integer::New(len), PropertyAttribute(ReadOnly | DontEnum | DontDelete));
+
+    new PackedArrayData(this, object, data, bytes);
+    return object;
+}
+
+static inline SV* number2sv(int16_t v)  { return newSViv(v); }
+static inline SV* number2sv(uint16_t v) { return newSViv(v); }
+static inline SV* number2sv(int32_t v)  { return newSViv(v); }
+static inline SV* number2sv(uint32_t v) { return newSVuv(v); }
+static inline SV* number2sv(float v)    { return newSVnv(v); }
+static inline SV* number2sv(double v)   { return newSVnv(v); }
+
+template <class T>
+static void
+fill_numbers(SV** items, const void* data, int len) {
+    const T* p = static_cast<const T*>(data);
+    for (int i = 0; i < len; i++)
+        items[i] = number2sv(p[i]);
+}
+
+// Typed and packed arrays are read straight from their storage
+SV*
+V8Context::numbers2sv(Handle<Object> object) {
+    int len = object->GetIndexedPropertiesExternalArrayDataLength();
+    const void *data = object->GetIndexedPropertiesExternalArrayData();
+
+    AV *av = newAV();
+    if (len > 0) {
+        av_extend(av, len - 1);
+        SV **items = AvARRAY(av);
+
+        switch (object->GetIndexedPropertiesExternalArrayDataType()) {
+            case kExternalShortArray:         fill_numbers<int16_t>(items, data, len); break;
+            case kExternalUnsignedShortArray: fill_numbers<uint16_t>(items, data, len); break;
+            case kExternalIntArray:           fill_numbers<int32_t>(items, data, len); break;
+            case kExternalUnsignedIntArray:   fill_numbers<uint32_t>(items, data, len); break;
+            case kExternalFloatArray:         fill_numbers<float>(items, data, len); break;
+            default:                          fill_numbers<double>(items, data, len); break;
+        }
+
+        AvFILLp(av) = len - 1;
+    }
+
+    return newRV_noinc((SV*)av);
+}
+
+// Arrays and hashes inside a live binding are live as well
+Handle<Value>
+V8Context::live2v8(SV *sv) {
+    if (SvROK(sv) && !SvOBJECT(SvRV(sv))) {
+        unsigned t = SvTYPE(SvRV(sv));
+        if (t == SVt_PVAV || t == SVt_PVHV)
+            return live2object(SvRV(sv));
+    }
+    return sv2v8(sv);
+}
+
+Handle<Object>
+V8Context::live2object(SV *sv) {
+    ObjectDataMap::iterator it = seen_perl.find(PTR2IV(sv));
+    if (it != seen_perl.end())
+        return it->second->object;
+
+    bool array = SvTYPE(sv) == SVt_PVAV;
+    Handle<Object> object = (array ? live_array_template : live_hash_template)->NewInstance();
+    if (array)
+        object->SetPrototype(
+            context->Global()->Get(String::New("Array"))->ToObject()->Get(String::New("prototype"))
+        );
+
+    PerlObjectData *data = new PerlObjectData(this, object, sv);
+    object->SetPointerInInternalField(0, data);
+    return data->object;
+}
+
 Handle<Object>
 V8Context::cv2function(CV *cv) {
     return (new PerlFunctionData(this, (SV*)cv))->object;
 }
 
+// Elements are converted in chunks, each in a handle scope of its own
+#define ARRAY_CHUNK 256
+
 SV*
 V8Context::array2sv(Handle<Array> array, SvMap& seen) {
     AV *av = newAV();
     SV *rv = newRV_noinc((SV*)av);
     SvREFCNT_inc(rv);
 
-    seen.add(array, PTR2IV(av));
+    seen.add(array, (SV*)av);
+
+    uint32_t len = array->Length();
+    if (!len)
+        return rv;
+
+    av_extend(av, len - 1);
+    SV **items = AvARRAY(av);
+
+    for (uint32_t start = 0; start < len; start += ARRAY_CHUNK) {
+        HandleScope chunk_scope;
+        uint32_t end = start + ARRAY_CHUNK < len ? start + ARRAY_CHUNK : len;
 
-    for (int i = 0; i < array->Length(); i++) {
-        Handle<Value> elementVal = array->Get( Integer::New( i ) );
-        av_push(av, v82sv(elementVal, seen));
+        for (uint32_t i = start; i < end; i++) {
+            items[i] = v82sv(array->Get(i), seen);
+            AvFILLp(av) = i;
+        }
     }
+
     return rv;
 }
 
@@ -717,7 +3161,7 @@ V8Context::object2sv(Handle<Object> obj, SvMap& seen) {
     SV *rv = newRV_noinc((SV*)hv);
     SvREFCNT_inc(rv);
 
-    seen.add(obj, PTR2IV(hv));
+    seen.add(obj, (SV*)hv);
 
     Local<Array> properties = obj->GetPropertyNames();
     for (int i = 0; i < properties->Length(); i++) {
@@ -758,9 +3202,10 @@ my_gv_setsv(pTHX_ GV* const gv, SV* const sv){
         /* We have to do all this inside a block so that all the proper \
          * destuctors are called if we need to croak. If we just croak in the \
          * middle of the block, v8 will segfault at program exit. */ \
+        V8FunctionData* data = (V8FunctionData*)sv_object_data((SV*)cv); \
+        IsolateScope    isolate_scope(data->context ? data->context->isolate : NULL); \
         TryCatch        try_catch; \
         HandleScope     scope; \
-        V8FunctionData* data = (V8FunctionData*)sv_object_data((SV*)cv); \
         if (data->context) { \
         V8Context      *self = data->context; \
         Handle<Context> ctx  = self->context; \
@@ -827,47 +3272,100 @@ V8Context::function2sv(Handle<Function> fn) {
     return newRV_noinc((SV*)code);
 }
 
+// Package made for the objects of one JavaScript prototype, remembered on
+// the prototype. Holds a reference to the stash until the prototype is
+// collected.
+struct BlessedPackage {
+    string name; // __perlPackage it was made for
+    HV* stash;
+    Persistent<Object> prototype;
+
+    BlessedPackage(const char* name_, HV* stash_, Handle<Object> prototype_)
+        : name(name_)
+        , stash((HV*)SvREFCNT_inc((SV*)stash_))
+        , prototype(Persistent<Object>::New(prototype_))
+    {
+        prototype.MakeWeak(this, destroy);
+    }
+
+    ~BlessedPackage() {
+        SvREFCNT_dec((SV*)stash);
+        prototype.Dispose();
+    }
+
+    // Packages deleted from Perl lose their name
+    bool valid(const char* name_) const {
+#ifdef HvENAME_get
+        return HvENAME_get(stash) && name == name_;
+#else
+        return HvNAME_get(stash) && name == name_;
+#endif
+    }
+
+    static void destroy(Persistent<Value> object, void* data) {
+        delete static_cast<BlessedPackage*>(data);
+    }
+};
+
 SV*
 V8Context::object2blessed(Handle<Object> obj) {
-    char package[128];
+    // The package of objects sharing a prototype is remembered on it, unless
+    // an object names its own
+    Local<Value> proto = obj->GetPrototype();
+    bool shared = proto->IsObject() && !obj->HasRealNamedProperty(String::NewSymbol("__perlPackage"));
+    Local<String> package_key = String::NewSymbol("__perlStash");
+    String::AsciiValue js_name(obj->Get(String::NewSymbol("__perlPackage"))->ToString());
+
+    HV *stash = NULL;
+    if (shared) {
+        Local<Value> cached = proto->ToObject()->GetHiddenValue(package_key);
+        if (!cached.IsEmpty()) {
+            BlessedPackage *package = static_cast<BlessedPackage*>(External::Unwrap(cached));
+            if (package->valid(*js_name))
+                stash = package->stash;
+        }
+    }
 
-    snprintf(
-        package,
-        128,
-        "%s%s::N%d",
-        bless_prefix.c_str(),
-        *String::AsciiValue(obj->Get(String::New("__perlPackage"))->ToString()),
-        number
-    );
+    if (!stash) {
+        std::ostringstream package;
+        package << bless_prefix << *js_name << "::N" << number;
+        std::string package_name = package.str();
 
-    HV *stash = gv_stashpv(package, 0);
+        stash = gv_stashpvn(package_name.data(), package_name.length(), 0);
 
-    if (!stash) {
-        Local<Object> prototype = obj->GetPrototype()->ToObject();
+        if (!stash) {
+            Local<Object> prototype = proto->ToObject();
 
-        stash = gv_stashpv(package, GV_ADD);
+            stash = gv_stashpvn(package_name.data(), package_name.length(), GV_ADD);
 
-        Local<Array> properties = prototype->GetPropertyNames();
-        for (int i = 0; i < properties->Length(); i++) {
-            Local<String> name = properties->Get(i)->ToString();
-            Local<Value> property = prototype->Get(name);
+            Local<Array> properties = prototype->GetPropertyNames();
+            for (int i = 0; i < properties->Length(); i++) {
+                Local<String> name = properties->Get(i)->ToString();
+                Local<Value> property = prototype->Get(name);
 
-            if (!property->IsFunction())
-                continue;
+                if (!property->IsFunction())
+                    continue;
+
+                Local<Function> fn = Local<Function>::Cast(property);
 
-            Local<Function> fn = Local<Function>::Cast(property);
+                CV *code = newXS(NULL, v8method, __FILE__);
+                V8ObjectData *data = new V8FunctionData(this, fn, (SV*)code);
 
-            CV *code = newXS(NULL, v8method, __FILE__);
-            V8ObjectData *data = new V8FunctionData(this, fn, (SV*)code);
+                GV* gv = (GV*)*hv_fetch(stash, *String::AsciiValue(name), name->Length(), TRUE);
+                gv_init(gv, stash, *String::AsciiValue(name), name->Length(), GV_ADDMULTI); /* vivify */
+                my_gv_setsv(aTHX_ gv, (SV*)code);
+            }
+        }
 
-            GV* gv = (GV*)*hv_fetch(stash, *String::AsciiValue(name), name->Length(), TRUE);
-            gv_init(gv, stash, *String::AsciiValue(name), name->Length(), GV_ADDMULTI); /* vivify */
-            my_gv_setsv(aTHX_ gv, (SV*)code);
+        if (shared) {
+            BlessedPackage *package = new BlessedPackage(*js_name, stash, proto->ToObject());
+            proto->ToObject()->SetHiddenValue(package_key, External::Wrap(package));
         }
     }
 
     SV* rv = newSV(0);
-    SV* sv = newSVrv(rv, package);
+    SV* sv = newSVrv(rv, NULL);
+    sv_bless(rv, stash);
     V8ObjectData *data = new V8ObjectData(this, obj, sv);
     sv_setiv(sv, PTR2IV(data));
 
@@ -886,11 +3384,13 @@ V8Context::idle_notification() {
         hs.used_heap_size()
     );
     */
+    IsolateScope isolate_scope(isolate);
     return V8::IdleNotification();
 }
 
 int
 V8Context::adjust_amount_of_external_allocated_memory(int change_in_bytes) {
+    IsolateScope isolate_scope(isolate);
     return V8::AdjustAmountOfExternalAllocatedMemory(change_in_bytes);
 }
 
@@ -5,7 +5,11 @@
 
 #include <vector>
 #include <map>
+#include <list>
+#include <deque>
+#include <set>
 #include <string>
+#include <algorithm>
 
 #ifdef __cplusplus
 extern "C" {
@@ -23,39 +27,234 @@ extern "C" {
 using namespace v8;
 using namespace std;
 
-typedef map<string, Persistent<Object> > ObjectMap;
-
-class SimpleObjectData {
+class PerlPrototype;
+
+// Slots for the lookup tables of a conversion, owned by the context so
+// that converting a big structure allocates only while the table grows the
+// first time. A conversion nested in another one (a tied hash calling back
+// into JavaScript) finds the arena busy and uses slots of its own.
+//
+// Only the slots a conversion used are cleared afterwards. If Perl dies in
+// the middle of a conversion the arena is released when the stack unwinds
+// and the slots are cleared on next use.
+template <class Slot>
+class SlotArena {
 public:
-    Handle<Object> object;
-    long ptr;
+    vector<Slot> slots;
+    vector<size_t> touched;
+    bool busy;
 
-    SimpleObjectData(Handle<Object> object_, long ptr_)
-        : object(object_)
-        , ptr(ptr_)
-    { }
+    SlotArena() : busy(false) { }
+
+    void scrub();
 };
 
-class SvMap {
-    typedef multimap<int, SimpleObjectData*> sv_map;
-    sv_map objects;
+// Past this many slots the arena is freed rather than kept for next time
+#define SLOT_ARENA_KEEP (1 << 16)
+
+template <class Slot>
+void SlotArena<Slot>::scrub() {
+    if (slots.size() > SLOT_ARENA_KEEP) {
+        vector<Slot>().swap(slots);
+        vector<size_t>().swap(touched);
+        return;
+    }
+
+    for (vector<size_t>::iterator it = touched.begin(); it != touched.end(); it++)
+        slots[*it] = Slot();
+    touched.clear();
+}
+
+// Open addressing with linear probing. A Slot is empty when default
+// constructed and knows the hash of its key.
+template <class Slot>
+class FlatTable {
+    SlotArena<Slot>* arena;
+
+    bool in_arena() const { return arena && slots == &arena->slots; }
+
+protected:
+    vector<Slot> own;
+    vector<Slot>* slots;
+    size_t used;
+
+    size_t mask() const { return slots->size() - 1; }
+
+    Slot& insert(size_t hash) {
+        if (!slots || (used + 1) * 2 > slots->size())
+            grow();
+
+        size_t i = hash & mask();
+        while (!(*slots)[i].empty())
+            i = (i + 1) & mask();
+
+        if (in_arena())
+            arena->touched.push_back(i);
+        used++;
+        return (*slots)[i];
+    }
+
+    void grow() {
+        if (!slots) {
+            if (arena && !arena->busy) {
+                // Released by the destructor, or by Perl unwinding the scope
+                ENTER;
+                SAVEBOOL(arena->busy);
+                arena->busy = true;
+                arena->scrub();
+                slots = &arena->slots;
+            }
+            else {
+                slots = &own;
+            }
+            if (slots->size())
+                return;
+        }
+
+        vector<Slot> old;
+        old.swap(*slots);
+        slots->resize(old.size() ? old.size() * 2 : 64);
+
+        if (in_arena())
+            arena->touched.clear();
+
+        for (typename vector<Slot>::iterator it = old.begin(); it != old.end(); it++) {
+            if (it->empty())
+                continue;
+            size_t i = it->hash() & mask();
+            while (!(*slots)[i].empty())
+                i = (i + 1) & mask();
+            (*slots)[i] = *it;
+            if (in_arena())
+                arena->touched.push_back(i);
+        }
+    }
 
 public:
-    SvMap () { }
+    FlatTable(SlotArena<Slot>* arena_ = NULL)
+        : arena(arena_)
+        , slots(NULL)
+        , used(0)
+    { }
+
+    size_t capacity() const { return slots ? slots->size() : 0; }
+    Slot& at(size_t i) { return (*slots)[i]; }
+
+    void clear() {
+        if (slots)
+            fill(slots->begin(), slots->end(), Slot());
+        used = 0;
+    }
 
-    ~SvMap() {
-        for (sv_map::iterator it = objects.begin(); it != objects.end(); it++)
-            delete it->second;
+    ~FlatTable() {
+        if (!in_arena())
+            return;
+
+        arena->scrub();
+        arena->busy = false;
+        LEAVE;
     }
+};
+
+static inline size_t
+pointer_hash(const void* ptr) {
+    size_t h = (size_t)ptr;
+    h ^= h >> 16;
+    h *= 0x45d9f3bu;
+    h ^= h >> 16;
+    return h;
+}
+
+// V8 objects already converted to Perl, found by identity hash. The
+// objects themselves are kept in a V8 array made in the scope of the
+// top-level conversion, so nested conversions may use short-lived handle
+// scopes.
+struct SvMapSlot {
+    int identity;
+    uint32_t index;
+    SV* sv;
+
+    SvMapSlot() : identity(0), index(0), sv(NULL) { }
 
-    void add(Handle<Object> object, long ptr);
+    bool empty() const { return !sv; }
+    size_t hash() const { return identity; }
+};
+
+class SvMap : public FlatTable<SvMapSlot> {
+    Handle<Array> objects;
+
+public:
+    SvMap(SlotArena<SvMapSlot>* arena = NULL)
+        : FlatTable<SvMapSlot>(arena)
+        , objects(Array::New())
+    { }
+
+    void add(Handle<Object> object, SV* sv);
     SV* find(Handle<Object> object);
 };
 
-typedef map<int, Handle<Value> > HandleMap;
+// Prototypes of blessed objects, found by stash
+struct PrototypeSlot {
+    HV* stash;
+    PerlPrototype* prototype;
+
+    PrototypeSlot() : stash(NULL), prototype(NULL) { }
+
+    bool empty() const { return !stash; }
+    size_t hash() const { return pointer_hash(stash); }
+};
+
+class PrototypeMap : public FlatTable<PrototypeSlot> {
+public:
+    void add(HV* stash, PerlPrototype* prototype);
+    PerlPrototype* find(HV* stash);
+};
+
+// Perl values already converted to V8, found by address
+struct HandleMapSlot {
+    SV* sv;
+    Handle<Value> value;
+
+    HandleMapSlot() : sv(NULL) { }
+
+    bool empty() const { return !sv; }
+    size_t hash() const { return pointer_hash(sv); }
+};
+
+class HandleMap : public FlatTable<HandleMapSlot> {
+public:
+    HandleMap(SlotArena<HandleMapSlot>* arena = NULL)
+        : FlatTable<HandleMapSlot>(arena)
+    { }
+
+    void add(SV* sv, Handle<Value> value);
+    Handle<Value> find(SV* sv);
+};
 
 class V8Context;
 
+// Locks and enters the isolate of a context that owns one. Contexts sharing
+// the default isolate pass NULL and just take the lock: once any Locker is
+// in use V8 insists on locking for every isolate.
+class IsolateScope {
+    Isolate* isolate;
+    Locker locker;
+
+public:
+    IsolateScope(Isolate* isolate_)
+        : isolate(isolate_)
+        , locker(isolate_)
+    {
+        if (isolate)
+            isolate->Enter();
+    }
+
+    ~IsolateScope() {
+        if (isolate)
+            isolate->Exit();
+    }
+};
+
 class ObjectData {
 public:
     V8Context* context;
@@ -66,6 +265,9 @@ public:
     ObjectData() {};
     ObjectData(V8Context* context_, Handle<Object> object_, SV* sv);
     virtual ~ObjectData();
+
+    // Called when the isolate of the context is about to go away
+    virtual void release();
 };
 
 class V8ObjectData : public ObjectData {
@@ -84,6 +286,7 @@ public:
     virtual ~PerlObjectData();
 
     virtual size_t size();
+    virtual void release();
     void add_size(size_t bytes_);
 
     static void destroy(Persistent<Value> object, void *data);
@@ -91,23 +294,177 @@ public:
 
 typedef map<int, ObjectData*> ObjectDataMap;
 
+// Element storage of an array converted with packed_arrays, freed when V8
+// collects the array
+class PackedArrayData {
+public:
+    V8Context* context;
+    Persistent<Object> object;
+    void* data;
+    size_t bytes;
+
+    PackedArrayData(V8Context* context_, Handle<Object> object_, void* data_, size_t bytes_);
+    ~PackedArrayData();
+
+    static void destroy(Persistent<Value> object, void *data);
+};
+
+typedef set<PackedArrayData*> PackedArraySet;
+
+class ScriptCacheEntry {
+public:
+    size_t hash;
+    string source;
+    string origin;
+    Persistent<Script> script;
+
+    ScriptCacheEntry(size_t hash_, const string& source_, const string& origin_, Handle<Script> script_)
+        : hash(hash_)
+        , source(source_)
+        , origin(origin_)
+        , script(Persistent<Script>::New(script_))
+    { }
+
+    ~ScriptCacheEntry() {
+        script.Dispose();
+    }
+};
+
+// LRU cache of compiled scripts, keyed by a hash of the source and origin.
+class ScriptCache {
+    typedef list<ScriptCacheEntry*> entry_list;
+    typedef multimap<size_t, entry_list::iterator> entry_index;
+
+    entry_list entries; // most recently used first
+    entry_index index;
+    size_t capacity_;
+
+    void evict();
+
+public:
+    long hits;
+    long misses;
+
+    ScriptCache(size_t capacity)
+        : capacity_(capacity)
+        , hits(0)
+        , misses(0)
+    { }
+
+    ~ScriptCache() {
+        clear();
+    }
+
+    Handle<Script> find(const string& source, const string& origin);
+    void add(const string& source, const string& origin, Handle<Script> script);
+    void clear();
+
+    size_t size() const { return entries.size(); }
+    size_t capacity() const { return capacity_; }
+};
+
+// Pre-compilation data for a script source, loaded by load_code_cache().
+class CodeCacheEntry {
+public:
+    string source;
+    vector<char> bytes; // ScriptData::New() keeps pointing into aligned input
+    ScriptData* data;
+
+    CodeCacheEntry(const string& source_, const char* bytes_, size_t length)
+        : source(source_)
+        , bytes(bytes_, bytes_ + length)
+        , data(ScriptData::New(length ? &bytes[0] : "", length))
+    { }
+
+    ~CodeCacheEntry() {
+        delete data;
+    }
+};
+
+typedef multimap<size_t, CodeCacheEntry*> CodeCacheMap;
+
+class V8Script {
+public:
+    V8Context* context;
+    Persistent<Script> script;
+
+    V8Script(V8Context* context_, Handle<Script> script_);
+    ~V8Script();
+
+    SV* run();
+};
+
+typedef set<V8Script*> ScriptSet;
+
+// Tie object behind the containers returned with lazy_results. Elements
+// are converted when first read and kept in an AV or HV.
+class V8Proxy {
+public:
+    V8Context* context;
+    Persistent<Object> object;
+    Persistent<Array> keys;
+    uint32_t next_key;
+    SV* cache;
+
+    V8Proxy(V8Context* context_, Handle<Object> object_);
+    ~V8Proxy();
+
+    SV* fetch(SV* key);
+    bool exists(SV* key);
+    int fetchsize();
+    int scalar();
+    SV* firstkey();
+    SV* nextkey(SV* lastkey = NULL);
+};
+
+typedef set<V8Proxy*> ProxySet;
+
+class WorkerPool;
+class PerlFunctionData;
+typedef map<long, SV*> AsyncCallbackMap;
+
 class V8Context {
     public:
         V8Context(
-            int time_limit = 0,
+            int time_limit_ms = 0,
             const char* flags = NULL,
             bool enable_blessing = false,
-            const char* bless_prefix = NULL
+            const char* bless_prefix = NULL,
+            int script_cache_size = 0,
+            int cpu_time_limit_ms = 0,
+            int max_young_space_size = 0,
+            int max_old_space_size = 0,
+            bool own_isolate = false,
+            int async_workers = 1,
+            bool lazy_results = false,
+            bool packed_arrays = false
         );
         ~V8Context();
 
+        Isolate* isolate; // NULL when using the default isolate
+
         void bind(const char*, SV*);
         void bind_ro(const char*, SV*);
+        void bind_live(const char*, SV*);
+        void bind_json(const char* name, SV* json);
+        void bind_buffer(const char* name, SV* ref);
+        void unbind_buffer(SV* ref);
+        void transfer(const char* name, SV* data);
+        SV* export_value(const char* name);
         SV* eval(SV* source, SV* origin = NULL);
+        SV* eval_json(SV* source, SV* origin = NULL);
+        V8Script* compile(SV* source, SV* origin = NULL);
+        void eval_async(SV* source, SV* callback);
+        int async_fd();
+        int async_poll(bool block = false);
+        SV* run(Handle<Script> script, TryCatch& try_catch, bool json = false);
         bool idle_notification();
         int adjust_amount_of_external_allocated_memory(int bytes);
         void set_flags_from_string(char *str);
         void name_global(const char *str);
+        SV* script_cache_stats();
+        SV* create_code_cache(SV* source);
+        bool load_code_cache(SV* source, SV* cache);
 
         Handle<Value> sv2v8(SV*);
         SV*           v82sv(Handle<Value>);
@@ -117,37 +474,83 @@ class V8Context {
         void register_object(ObjectData* data);
         void remove_object(ObjectData* data);
 
-        Persistent<Function> make_function;
+        void register_script(V8Script* script);
+        void remove_script(V8Script* script);
+
+        PackedArraySet packed;
+
+        void register_proxy(V8Proxy* proxy);
+        void remove_proxy(V8Proxy* proxy);
+        SV* lazy2sv(Handle<Value> value);
+
+        Handle<Object> make_function(PerlFunctionData* data);
+        Handle<Value> live2v8(SV* sv);
 
         bool enable_wantarray;
 
     private:
         Handle<Value>    sv2v8(SV*, HandleMap& seen);
         SV*              v82sv(Handle<Value>, SvMap& seen);
+        SV*              primitive2sv(Handle<Value>);
 
         Handle<Value>    rv2v8(SV*, HandleMap& seen);
-        Handle<Array>    av2array(AV*, HandleMap& seen, long ptr);
-        Handle<Object>   hv2object(HV*, HandleMap& seen, long ptr);
+        Handle<Array>    av2array(AV*, HandleMap& seen);
+        Handle<Object>   hv2object(HV*, HandleMap& seen);
         Handle<Object>   cv2function(CV*);
+        Handle<Object>   live2object(SV*);
+        Handle<Object>   buffer2object(SV*);
+        Handle<Object>   av2packed(AV*);
         Handle<String>   sv2v8str(SV* sv);
         Handle<Object>   blessed2object(SV *sv);
 
+        Handle<Script>   compile_script(SV* source, SV* origin);
+        Handle<Script>   compile_uncached(SV* source, SV* origin);
+        ScriptData*      find_code_cache(const char* source, size_t length);
+
         SV* array2sv(Handle<Array>, SvMap& seen);
         SV* object2sv(Handle<Object>, SvMap& seen);
         SV* object2blessed(Handle<Object>);
+        SV* string2sv(Handle<String>);
         SV* function2sv(Handle<Function>);
+        SV* bytes2sv(Handle<Object>);
+        SV* numbers2sv(Handle<Object>);
 
         Persistent<String> string_wrap;
+        Persistent<Function> function_factory;
+        Persistent<ObjectTemplate> function_holder;
+        Persistent<ObjectTemplate> live_array_template;
+        Persistent<ObjectTemplate> live_hash_template;
+        Persistent<ObjectTemplate> prototype_template;
+        Persistent<Function> json_parse;
+        Persistent<Function> json_stringify;
 
-        void fill_prototype(Handle<Object> prototype, HV* stash);
         Handle<Object> get_prototype(SV* sv);
 
-        ObjectMap prototypes;
+        PrototypeMap prototypes;
+
+        ScriptCache script_cache;
+        ScriptSet scripts;
+        ProxySet proxies;
+        bool lazy_results_;
+        bool packed_arrays_;
+        CodeCacheMap code_caches;
 
         ObjectDataMap seen_perl;
+        SlotArena<SvMapSlot> sv_arena;
+        SlotArena<HandleMapSlot> handle_arena;
         SV* seen_v8(Handle<Object> object);
 
-        int time_limit_;
+        int time_limit_ms_;
+        int cpu_time_limit_ms_;
+        size_t heap_limit_;
+        int max_young_space_size_;
+        int max_old_space_size_;
+
+        WorkerPool* workers;
+        int async_workers_;
+        long async_id_;
+        AsyncCallbackMap async_callbacks;
+
         string bless_prefix;
         bool enable_blessing;
         static int number;
@@ -5,6 +5,8 @@ use warnings;
 our $VERSION = '0.07';
 
 use JavaScript::V8::Context;
+use JavaScript::V8::Script;
+use JavaScript::V8::Proxy;
 require XSLoader;
 XSLoader::load('JavaScript::V8', $VERSION);
 
@@ -88,6 +90,10 @@ Similar packages may be available for other distributions (adjust the package na
 Details on the context object and the mapping between JavaScript and Perl
 types.
 
+=item * L<JavaScript::V8::Script>
+
+Compiled scripts which can be run many times.
+
 =back
 
 =head2 Extension modules
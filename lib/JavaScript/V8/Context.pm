@@ -4,21 +4,61 @@ sub new {
     my($class, %args) = @_;
 
     my $time_limit = delete $args{time_limit} || 0;
+    my $time_limit_ms = delete $args{time_limit_ms} || int($time_limit * 1000);
+    my $cpu_time_limit_ms = delete $args{cpu_time_limit_ms} || 0;
+    my $max_young_space_size = delete $args{max_young_space_size} || 0;
+    my $max_old_space_size = delete $args{max_old_space_size} || 0;
+    for ($max_young_space_size, $max_old_space_size) {
+        die "Heap sizes must be whole megabytes from 0 to 2047\n" unless /^\d+$/ && $_ < 2048;
+    }
+    my $own_isolate = delete $args{own_isolate} ? 1 : 0;
+    my $async_workers = delete $args{async_workers} || 1;
     my $flags = delete $args{flags} || '';
     my $enable_blessing 
         = exists $args{enable_blessing} 
         ? delete $args{enable_blessing} 
         : (exists $args{bless_prefix} ? 1 : 0);
     my $bless_prefix = delete $args{bless_prefix} || '';
+    my $script_cache_size = delete $args{script_cache_size} || 0;
+    my $lazy_results = delete $args{lazy_results} ? 1 : 0;
+    my $packed_arrays = delete $args{packed_arrays} ? 1 : 0;
 
-    $class->_new($time_limit, $flags, $enable_blessing, $bless_prefix);
+    $class->_new($time_limit_ms, $flags, $enable_blessing, $bless_prefix, $script_cache_size, $cpu_time_limit_ms,
+        $max_young_space_size, $max_old_space_size, $own_isolate, $async_workers,
+        $lazy_results, $packed_arrays);
 }
 
+# Contexts belong to the thread that created them
+sub CLONE_SKIP { 1 }
+
 sub bind_function {
     my $class = shift;
     $class->bind(@_);
 }
 
+sub save_code_cache {
+    my($self, $file, $source) = @_;
+
+    my $cache = $self->create_code_cache($source);
+    return unless defined $cache;
+
+    open my $fh, '>:raw', $file or die "Can't write $file: $!\n";
+    print $fh $cache;
+    close $fh or die "Can't write $file: $!\n";
+
+    return 1;
+}
+
+sub load_code_cache_file {
+    my($self, $file, $source) = @_;
+
+    open my $fh, '<:raw', $file or return;
+    my $cache = do { local $/; <$fh> };
+    close $fh;
+
+    return $self->load_code_cache($source, $cache);
+}
+
 1;
 
 =head1 NAME
@@ -54,6 +94,55 @@ Several optional parameters are accepted:
 Force an exception after the script has run for a number of seconds; this
 limit will be enforced even if V8 calls back to Perl or blocks on IO.
 
+When a script is stopped by this or one of the limits below, C<eval()>
+returns undef and $@ is set to C<"Execution terminated: time limit
+exceeded\n"> (or C<CPU time limit> for C<cpu_time_limit_ms>), so timeouts
+can be told apart from errors thrown by the script with
+C<$@ =~ /^Execution terminated:/>.
+
+=item time_limit_ms
+
+Like C<time_limit>, but in milliseconds. Takes precedence over
+C<time_limit>.
+
+=item cpu_time_limit_ms
+
+Force an exception after the script has used this many milliseconds of CPU
+time, measured with the CPU clock of the running thread. Time spent blocked
+(for example sleeping or waiting for IO in a Perl callback) does not count.
+On systems without per-thread CPU clocks this behaves like C<time_limit_ms>.
+
+=item max_young_space_size
+
+=item max_old_space_size
+
+Limit the size of the young and old generations of the V8 heap, in
+megabytes from 1 to 2047 (like the V8 flags of the same name). V8 can only apply these to
+a heap which has not been set up yet, i.e. when this is the first context
+in the process or the context has C<own_isolate> set. Otherwise they are
+ignored with a warning.
+
+Independently of that, once the live heap grows past 90% of
+C<max_old_space_size> while a script of this context is running, the
+script is terminated: C<eval()> returns undef and $@ is set to
+C<"Execution terminated: heap limit exceeded\n">. The check runs after
+garbage collections and compares the whole heap with the old generation
+limit, so it stops most runaway scripts, but V8 can still abort the
+process if an allocation fails before the check gets to run.
+
+=item own_isolate
+
+Give the context its own V8 isolate (a separate heap and VM) instead of
+sharing the default isolate with all other contexts. Time and heap limits
+then only ever terminate scripts of this context, heap size limits always
+apply, and contexts in different Perl threads can run JavaScript at the
+same time.
+
+=item async_workers
+
+Number of native threads running scripts for C<eval_async()>. Defaults to
+1. The threads are started on first use.
+
 =item enable_blessing
 
 If enabled, JavaScript objects that have the C<__perlPackage> property are
@@ -73,6 +162,41 @@ no effect unless C<enable_blessing> is set.
 Specify a string of flags to be passed to V8. See
 C<set_flags_from_string()> for more details.
 
+=item script_cache_size
+
+Keep up to this many compiled scripts per context, keyed by source and
+origin. A repeated C<eval()> of the same source skips parsing and
+compilation and just runs the cached script. Least recently used scripts are
+dropped once the cache is full. Defaults to 0 (no caching). See
+C<script_cache_stats()>.
+
+=item packed_arrays
+
+Convert Perl arrays of 16 or more plain numbers into packed arrays instead
+of JavaScript arrays. The numbers are copied in one pass into a flat block
+of doubles, so integers beyond 2**53 lose precision. The result has C<length>
+and the methods of C<Array.prototype>, and its elements can be read and
+written, but it can't grow or shrink and C<Array.isArray()> is false for it.
+Arrays holding anything else, including numeric strings, are converted as
+usual.
+
+Packed arrays, and typed arrays of V8 when it has them, always come back to
+Perl as array references of numbers, read in one pass. Byte-sized typed
+arrays come back as byte strings, see C<bind_buffer()>.
+
+=item lazy_results
+
+Return arrays and objects from C<eval()> and C<run()> as tied array and
+hash references instead of converting them up front. An element is only
+converted when it is first read and is remembered after that, so a script
+returning a huge structure costs only as much as Perl actually looks at.
+Nested arrays and objects are converted lazily too.
+
+The tied containers are read-only views of the live JavaScript objects:
+changes made by later scripts show up in elements not read yet. The same
+JavaScript object reached along two paths gives two different Perl
+references. Reading from them after the context is gone dies.
+
 =back
 
 =item bind ( name => $scalar )
@@ -164,6 +288,81 @@ version (the binding may become more complete).
 Like C<bind()> but makes the item read-only on the global object (i.e. it is
 not recursive, if you need that use tie or other Perl mechanisms).
 
+=item bind_live ( $name => $array_or_hash_ref )
+
+Binds an array or hash without copying it. JavaScript reads and writes go
+straight to the Perl container, so binding is cheap however big the data
+is, and changes made on either side are seen by the other. Arrays and
+hashes stored inside are live as well; other values are converted on each
+read like C<bind()> does.
+
+  my %seen;
+  $context->bind_live(seen => \%seen);
+  $context->eval('seen["a"] = 1');
+  print $seen{a}; # 1
+
+A live array has C<length> and the methods of C<Array.prototype>, but
+C<Array.isArray()> is false for it. Values written from JavaScript are
+converted to Perl when they are stored.
+
+=item bind_json ( $name => $json )
+
+Parses the JSON text in I<$json> with the JSON parser of V8 and binds the
+result as I<$name>, without decoding it into Perl data first. Dies with the
+JavaScript error if the text is not valid JSON. C<JSON.parse> and
+C<JSON.stringify> are looked up when the context is created, so scripts
+replacing them don't affect C<bind_json()> and C<eval_json()>.
+
+  $context->bind_json(input => $json_in);
+
+=item bind_buffer ( $name => \$bytes )
+
+Binds the bytes of a scalar to JavaScript without copying them. The
+JavaScript object reads and writes the string buffer of the scalar directly,
+one unsigned byte per index, like a C<Uint8Array>, and has C<length> and
+C<byteLength> properties. Writes from JavaScript change the scalar in place.
+
+  my $png = read_file('image.png', binmode => ':raw');
+  $context->bind_buffer(png => \$png);
+  my $width = $context->eval('(png[16] << 24 | png[17] << 16 | png[18] << 8 | png[19]) >>> 0');
+
+As the buffer can't move, the scalar is read-only in Perl while it is bound,
+until C<unbind_buffer()> is called on it, the context is destroyed or
+JavaScript lets go of it and it is garbage collected. Character strings are
+downgraded to bytes first; binding one with characters above 255 dies.
+
+=item unbind_buffer ( \$bytes )
+
+Releases a scalar bound with C<bind_buffer()> and makes it writable again.
+JavaScript references to the buffer stay valid but see it as empty, with a
+C<length> of 0. Scalars that aren't bound are left alone.
+
+  $context->bind_buffer(png => \$png);
+  ...
+  $context->unbind_buffer(\$png);
+  $png = '';
+
+Passing the object back to Perl gives the scalar reference again. Other byte
+arrays with external storage, such as typed arrays made by V8 when it
+supports them, are converted to byte strings.
+
+=item transfer ( $name => $data )
+
+Like C<bind()> for plain data, but faster for big structures: I<$data> is
+first written into a compact binary buffer in one pass over the Perl data
+and then read back as JavaScript values. Numbers, strings, arrays and hashes
+are copied, including repeated and cyclic references. Code references and
+blessed objects become C<undefined>.
+
+=item export ( $name )
+
+Returns a copy of the global variable I<$name>, going through the same
+binary buffer as C<transfer()>. JavaScript functions become undef, and
+booleans become 1 and 0.
+
+  $context->eval('var report = build_report()');
+  my $report = $context->export('report');
+
 =item bind_function ( $name => $subroutine_ref )
 
 DEPRECATED. This is just an alias for bind.
@@ -198,6 +397,94 @@ created by eval(), so JavaScript exceptions will propagate to Perl code.
 JavaScript function object having a C<__perlReturnsList> property set that
 returns an array will return a list to Perl when called in list context.
 
+=item eval_json ( $source[, $origin] )
+
+Like C<eval()>, but the result is turned into a JSON string by
+C<JSON.stringify> inside V8 and returned as a single (character) string.
+No Perl data structure is built for it. Returns undef, with $@ set, on
+errors, including results that can't be stringified such as cyclic ones.
+Returns undef without an error for results JSON has no text for, like
+C<undefined> or a function.
+
+  my $json_out = $context->eval_json('transform(input)');
+
+=item eval_async ( $source, $callback )
+
+Queues the JavaScript code given in I<$source> to run on a worker thread
+and returns immediately. Each worker has its own isolate and runs every
+script in a fresh context, so nothing bound into this context (including
+Perl functions) is visible to it. The C<time_limit>, C<cpu_time_limit_ms>
+and heap size options of this context apply.
+
+Once the script has finished and C<async_poll()> is called, I<$callback> is
+called with the result and an error message:
+
+  $callback->($result, undef);  # success
+  $callback->(undef, $error);   # failure, $error is what $@ would be
+
+Only plain data crosses back: numbers, strings, booleans, arrays and
+objects (as array and hash references, including cyclic ones). Functions
+become undef.
+
+=item async_fd ( )
+
+Returns a file descriptor which becomes readable when results of
+C<eval_async()> are ready. Watch it with your event loop and call
+C<async_poll()> when it fires:
+
+  my $w = AnyEvent->io(
+    fh   => $context->async_fd,
+    poll => 'r',
+    cb   => sub { $context->async_poll },
+  );
+
+Worker threads do not survive C<fork()>, so only start using them in the
+process which will run the scripts.
+
+=item async_poll ( [$block] )
+
+Calls the callbacks of all finished C<eval_async()> scripts and returns how
+many were called. If I<$block> is true and there are scripts outstanding,
+waits for at least one to finish first. Exceptions thrown by a callback
+propagate out of C<async_poll()>.
+
+=item compile ( $source[, $origin] )
+
+Compiles the JavaScript code given in I<$source> without running it and
+returns a L<JavaScript::V8::Script> object. Call C<run()> on it as often as
+needed; parsing and compilation only happen once.
+
+If there is a compilation error this method returns undef and $@ is set, as
+for C<eval()>.
+
+=item create_code_cache ( $source )
+
+Returns V8's pre-compilation data for I<$source> as a byte string, or undef
+with $@ set if the source does not compile. The data can be stored and
+handed to C<load_code_cache()> in another context or process.
+
+=item load_code_cache ( $source, $cache )
+
+Makes the pre-compilation data I<$cache> (from C<create_code_cache()>)
+available for I<$source>. Later calls to C<eval()> or C<compile()> with the
+same source use it to skip pre-parsing. Returns false if the data can't be
+used; data from a different V8 version is ignored by V8.
+
+=item save_code_cache ( $file, $source )
+
+=item load_code_cache_file ( $file, $source )
+
+Like C<create_code_cache()> and C<load_code_cache()>, but the data is
+written to or read from I<$file>. Useful to share the result of
+pre-parsing a large library with freshly forked workers:
+
+  # at build or deploy time
+  $context->save_code_cache("lib.cache", $library);
+
+  # in every worker
+  $context->load_code_cache_file("lib.cache", $library);
+  $context->eval($library);
+
 =item set_flags_from_string ( $flags )
 
 Set or unset various flags supported by V8 (see
@@ -226,6 +513,12 @@ V8 can currently do.
 
 Most users of C<JavaScript::V8> will not need this.
 
+=item script_cache_stats( )
+
+Returns a hash reference with the C<hits>, C<misses>, number of C<entries>
+and C<capacity> of the compiled script cache (see the C<script_cache_size>
+option to C<new()>). Useful for sizing the cache.
+
 =item name_global( $name )
 
 Give the global object a name that is accessible from JavaScript.  This is
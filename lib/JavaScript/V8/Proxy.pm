@@ -0,0 +1,27 @@
+package JavaScript::V8::Proxy;
+
+use Carp ();
+
+sub CLONE_SKIP { 1 }
+
+for my $method (qw(STORE STORESIZE EXTEND DELETE CLEAR PUSH POP SHIFT UNSHIFT SPLICE)) {
+    no strict 'refs';
+    *$method = sub { Carp::croak("Lazy results are read-only") };
+}
+
+1;
+
+=head1 NAME
+
+JavaScript::V8::Proxy - Tied view of a JavaScript array or object
+
+=head1 DESCRIPTION
+
+With the C<lazy_results> option of L<JavaScript::V8::Context>, arrays and
+objects returned from JavaScript are array and hash references tied to this
+class. Elements are converted from JavaScript when they are first read.
+
+There is nothing to call on these objects directly. Writing to a tied
+container dies.
+
+=cut
@@ -0,0 +1,39 @@
+package JavaScript::V8::Script;
+
+sub CLONE_SKIP { 1 }
+
+1;
+
+=head1 NAME
+
+JavaScript::V8::Script - A compiled script which can be run many times
+
+=head1 SYNOPSIS
+
+  use JavaScript::V8;
+
+  my $context = JavaScript::V8::Context->new();
+
+  my $script = $context->compile($source, 'bootstrap.js')
+    or die $@;
+
+  my $result = $script->run();
+
+=head1 INTERFACE
+
+Script objects are created by C<compile()> in L<JavaScript::V8::Context>.
+
+=over
+
+=item run( )
+
+Runs the compiled script in the context it was compiled in and returns the
+result from the last statement, converted exactly like the return value of
+C<eval()>. Errors are reported in $@, also as C<eval()> does. The
+C<time_limit> of the context applies to every run.
+
+Running a script after its context has been destroyed dies.
+
+=back
+
+=cut
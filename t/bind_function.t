@@ -47,4 +47,12 @@ is $context->eval('(function(x) { return x; })')->($zzz), undef, 'undef roundtri
 
 is $context->eval('(function(f) { try { f() } catch(e) { return "ok"; } })')->(sub { die 'err' }), 'ok', 'caught perl error in js';
 
+$context->bind(args => sub { [ scalar(@_), @_ ] });
+is_deeply $context->eval('args()'), [0], 'no arguments';
+is_deeply $context->eval('args(1, "two", 3)'), [3, 1, 'two', 3], 'all arguments arrive';
+is_deeply $context->eval('args.apply(null, [4, 5])'), [2, 4, 5], 'apply';
+is_deeply $context->eval('args(undefined, null, -7, 1.5, true, false, "\\u00fc")'),
+    [7, undef, undef, -7, 1.5, 1, 0, "\x{fc}"], 'primitive arguments';
+is $context->eval('typeof args'), 'function', 'bound code ref is a function';
+
 done_testing;
@@ -0,0 +1,82 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use utf8;
+use strict;
+use warnings;
+
+my $context = JavaScript::V8::Context->new();
+
+my %table = map { ("k$_" => $_) } 1..1000;
+$context->bind_live(table => \%table);
+
+is $context->eval('table.k500'), 500, 'read from hash';
+is $context->eval('table.missing'), undef, 'missing key';
+ok $context->eval('"k1" in table'), 'in';
+ok !$context->eval('"nope" in table'), 'not in';
+
+$context->eval('table.added = "from js"; table["ключ"] = 2');
+is $table{added}, 'from js', 'write reaches Perl';
+is $table{'ключ'}, 2, 'UTF-8 key';
+
+$table{k1} = 'changed';
+is $context->eval('table.k1'), 'changed', 'Perl changes are visible';
+
+$context->eval('delete table.k2');
+ok !exists $table{k2}, 'delete';
+
+is $context->eval('Object.keys(table).length'), scalar(keys %table), 'enumerate keys';
+
+my @list = (1, 2, 3);
+$context->bind_live(list => \@list);
+is $context->eval('list.length'), 3, 'length';
+is $context->eval('list[1]'), 2, 'read from array';
+$context->eval('list.push(4); list[0] = "zero"');
+is_deeply \@list, ['zero', 2, 3, 4], 'writes reach Perl';
+is $context->eval('list.map(function(x) { return x + "!" }).join(",")'), 'zero!,2!,3!,4!', 'array methods';
+$context->eval('list.length = 2');
+is_deeply \@list, ['zero', 2], 'setting length';
+
+my %deep = (inner => { list => [1] });
+$context->bind_live(deep => \%deep);
+$context->eval('deep.inner.list.push(2); deep.inner.x = 1');
+is_deeply \%deep, { inner => { list => [1, 2], x => 1 } }, 'nested containers are live';
+
+is $context->eval('(function(x) { return x })')->(\%deep), \%deep, 'same Perl hash comes back';
+
+{
+    package DyingHash;
+    require Tie::Hash;
+    our @ISA = ('Tie::StdHash');
+    sub STORE { die "no stores\n" }
+}
+
+{
+    my @fixed = (1, 2);
+    Internals::SvREADONLY(@fixed, 1);
+    $context->bind_live(fixed => \@fixed);
+    like $context->eval('try { fixed.length = 5; "stored" } catch (e) { e }'), qr/read-only/, 'readonly array throws in JS';
+
+    my %restricted = (a => 1);
+    Internals::SvREADONLY(%restricted, 1);
+    $context->bind_live(restricted => \%restricted);
+    like $context->eval('try { restricted.b = 1; "stored" } catch (e) { e }'), qr/disallowed key/, 'restricted hash throws in JS';
+    is $context->eval('restricted.a = 2'), 2, 'allowed key of restricted hash';
+    is $restricted{a}, 2, 'allowed key is stored';
+
+    tie my %tied, 'DyingHash';
+    $context->bind_live(tied => \%tied);
+    is $context->eval('try { tied.x = 1; "stored" } catch (e) { e }'), 'no stores', 'die in tied STORE throws in JS';
+
+    my %walked = (a => 1, b => 2, c => 3);
+    $context->bind_live(walked => \%walked);
+    my ($first) = each %walked;
+    $context->eval('Object.keys(walked)');
+    my ($second) = each %walked;
+    isnt $second, $first, 'enumerating from JS keeps the each() iterator';
+}
+
+eval { $context->bind_live(x => 1) };
+like $@, qr/array or hash reference/, 'needs a reference';
+
+done_testing;
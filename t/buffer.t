@@ -0,0 +1,74 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use strict;
+use warnings;
+
+my $context = JavaScript::V8::Context->new();
+
+my $bytes = join '', map { chr } 0..255;
+$context->bind_buffer(buf => \$bytes);
+
+is $context->eval('buf.length'), 256, 'length';
+is $context->eval('buf.byteLength'), 256, 'byteLength';
+is $context->eval('buf[0] + buf[255]'), 255, 'bytes read';
+is $context->eval('var sum = 0; for (var i = 0; i < buf.length; i++) sum += buf[i]; sum'), 255 * 128, 'sum';
+
+$context->eval('buf[1] = 0x41; buf[2] = 300');
+is substr($bytes, 1, 2), "A\x{2c}", 'writes change the scalar in place';
+is length($bytes), 256, 'length unchanged';
+
+eval { $bytes .= 'more' };
+like $@, qr/read-only/, 'scalar is read-only while bound';
+
+my $back = $context->eval('buf');
+is $back, \$bytes, 'same scalar comes back';
+
+my $chars = "caf\x{e9}";
+utf8::upgrade($chars);
+$context->bind_buffer(chars => \$chars);
+is $context->eval('chars[3]'), 0xe9, 'downgraded to bytes';
+
+my $wide = "\x{263a}";
+eval { $context->bind_buffer(wide => \$wide) };
+like $@, qr/Wide character/, 'wide characters die';
+
+eval { $context->bind_buffer(x => [1]) };
+like $@, qr/scalar reference/, 'needs a scalar reference';
+
+eval { $context->bind_buffer(lit => \"literal") };
+like $@, qr/writable scalar/, 'read-only scalars die';
+is $context->eval('typeof lit'), 'undefined', 'nothing bound';
+is $context->eval('1 + 1'), 2, 'context still usable';
+
+$context->bind_buffer(again => \$bytes);
+is $context->eval('again[1]'), 0x41, 'scalar bound already can be bound again';
+
+$context->eval('var kept = buf');
+$context->unbind_buffer(\$bytes);
+eval { $bytes .= 'more' };
+is $@, '', 'scalar is writable once unbound';
+is $context->eval('kept.length'), 0, 'unbound buffer is empty';
+is $context->eval('kept[0]'), undef, 'no bytes left';
+is $bytes, join('', map { chr } 0, 0x41, 0x2c, 3..255) . 'more', 'bytes kept';
+
+$context->unbind_buffer(\$bytes);
+pass 'unbinding twice is harmless';
+
+my $plain = 'plain';
+$context->unbind_buffer(\$plain);
+is $plain, 'plain', 'unbound scalars are left alone';
+
+eval { $context->unbind_buffer('x') };
+like $@, qr/scalar reference/, 'unbind needs a scalar reference';
+
+my $held = 'held';
+{
+    my $other = JavaScript::V8::Context->new();
+    $other->bind_buffer(held => \$held);
+    $other->eval('var keep = held');
+}
+eval { $held .= ' free' };
+is $@, '', 'scalar is writable once the context is gone';
+
+done_testing;
@@ -19,4 +19,14 @@ my $y = [];
 $y->[0] = $y;
 is_deeply $context->eval('(function(v) { return v; })')->($y), $y, 'circular array roundtrip';
 
+my $shared = { n => 1 };
+my $many = [ map { { id => $_, shared => $shared } } 1..5000 ];
+my $back = $context->eval('(function(v) { return v; })')->($many);
+is scalar(@$back), 5000, 'large structure roundtrip';
+is $back->[0]{shared}, $back->[4999]{shared}, 'shared references stay shared';
+
+my $js = $context->eval('var s = { n: 1 }, a = []; for (var i = 0; i < 5000; i++) a.push({ id: i, s: s }); a');
+is $js->[0]{s}, $js->[4999]{s}, 'shared JS objects stay shared';
+is $js->[4999]{id}, 4999, 'all elements converted';
+
 done_testing;
@@ -0,0 +1,48 @@
+#!/usr/bin/perl
+use Test::More;
+use File::Temp qw(tempdir);
+use JavaScript::V8;
+use strict;
+use warnings;
+
+my $source = join "\n", map { "function f$_(x) { return x + $_; }" } 1..100;
+$source .= "\nf42(1)";
+
+my $context = JavaScript::V8::Context->new();
+
+my $cache = $context->create_code_cache($source);
+ok defined $cache && length $cache, 'created code cache';
+
+ok !defined $context->create_code_cache("\nfunction("), 'no cache for broken source';
+like $@, qr/SyntaxError/, 'syntax error reported';
+
+{
+    my $context = JavaScript::V8::Context->new();
+    ok $context->load_code_cache($source, $cache), 'loaded code cache';
+    is $context->eval($source), 43, 'eval with code cache';
+    is $context->compile($source)->run, 43, 'compile with code cache';
+}
+
+{
+    my $dir = tempdir(CLEANUP => 1);
+    ok $context->save_code_cache("$dir/lib.cache", $source), 'saved to file';
+
+    my $context = JavaScript::V8::Context->new();
+    ok $context->load_code_cache_file("$dir/lib.cache", $source), 'loaded from file';
+    is $context->eval($source), 43;
+
+    ok !$context->load_code_cache_file("$dir/missing.cache", $source), 'missing file';
+}
+
+{
+    my $context = JavaScript::V8::Context->new();
+    {
+        my $copy = "$cache";
+        ok $context->load_code_cache($source, $copy), 'loaded from a temporary';
+        $copy = 'x' x length $copy;
+    }
+    my @noise = map { 'y' x length $cache } 1..10;
+    is $context->eval($source), 43, 'code cache outlives the scalar it was loaded from';
+}
+
+done_testing;
@@ -0,0 +1,32 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use strict;
+use warnings;
+
+my $context = JavaScript::V8::Context->new();
+
+my $script = $context->compile('var n = (typeof n == "undefined" ? 0 : n) + 1; n', 'counter.js');
+isa_ok $script, 'JavaScript::V8::Script';
+is $@, undef, '$@ is not set';
+
+is $script->run, $_, "run $_" for 1..3;
+is $context->eval('n'), 3, 'runs in the context it was compiled in';
+
+is_deeply $context->compile('[1, {a: 2}]')->run, [1, {a => 2}], 'result is converted';
+
+ok !defined $context->compile("\nfunction(", 'broken.js'), 'compile error returns undef';
+like $@, qr{SyntaxError:.* at broken\.js:2}, 'compile error sets $@';
+
+my $thrower = $context->compile('throw "oops"', 'thrower.js');
+ok !defined $thrower->run, 'runtime error returns undef';
+is $@, "oops at thrower.js:1:0\n", 'runtime error sets $@';
+
+{
+    my $context = JavaScript::V8::Context->new();
+    $script = $context->compile('1');
+}
+ok !eval { $script->run; 1 }, 'running a script without its context dies';
+like $@, qr/context is no more/;
+
+done_testing;
@@ -17,6 +17,20 @@ my $context = JavaScript::V8::Context->new();
     is_deeply($context->eval('["foo", "bar", "boo", "far"];'), \@expected);
 };
 
+{
+    my $big = $context->eval('var a = []; for (var i = 0; i < 500000; i++) a.push(i); a');
+    is scalar(@$big), 500000, 'big array length';
+    is $big->[499999], 499999, 'last element';
+    is_deeply [ @$big[0, 255, 256, 257] ], [0, 255, 256, 257], 'elements around chunk boundaries';
+};
+
+{
+    my $nested = $context->eval('var o = { n: 1 }, a = [o]; for (var i = 0; i < 1000; i++) a.push(i % 2 ? o : [i]); a.push(a); a');
+    is $nested->[0], $nested->[1000], 'shared object across chunks';
+    is $nested->[1001], $nested, 'cycle across chunks';
+    is_deeply $nested->[997], [996], 'nested array';
+    $nested->[1001] = undef;
+};
 
 done_testing;
 
@@ -0,0 +1,65 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use utf8;
+use strict;
+use warnings;
+
+my $context = JavaScript::V8::Context->new(async_workers => 2, time_limit_ms => 500);
+
+my %results;
+for my $n (1..5) {
+    $context->eval_async("var s = 0; for (var i = 1; i <= $n; i++) s += i; s", sub {
+        my($result, $error) = @_;
+        $results{$n} = $error || $result;
+    });
+}
+
+ok defined $context->async_fd, 'has a file descriptor';
+
+my $called = 0;
+$called += $context->async_poll(1) while keys %results < 5;
+is $called, 5, 'all callbacks called';
+is_deeply \%results, { 1 => 1, 2 => 3, 3 => 6, 4 => 10, 5 => 15 }, 'results';
+
+my @got;
+my $cb = sub { @got = @_ };
+
+$context->eval_async('({ a: [1, 2.5, "тест", true, null], b: { c: "d" }, f: function() {} })', $cb);
+$context->async_poll(1);
+is_deeply $got[0], { a => [1, 2.5, 'тест', 1, undef], b => { c => 'd' }, f => undef }, 'plain data result';
+is $got[1], undef, 'no error';
+
+$context->eval_async('var o = { name: "loop" }; o.self = o; o', $cb);
+$context->async_poll(1);
+is $got[0]{self}, $got[0], 'cycles are kept';
+$got[0]{self} = undef;
+
+$context->eval_async('throw "oops"', $cb);
+$context->async_poll(1);
+is $got[0], undef, 'no result on error';
+is $got[1], "oops at eval:1:0\n", 'error message';
+
+$context->eval_async('for (;;) {}', $cb);
+$context->async_poll(1);
+is $got[1], "Execution terminated: time limit exceeded\n", 'time limit applies';
+
+$context->bind(perl_only => 1);
+$context->eval_async('typeof perl_only', $cb);
+$context->async_poll(1);
+is $got[0], 'undefined', 'runs in a fresh context';
+
+is $context->async_poll, 0, 'nothing left to poll';
+
+{
+    my @seen;
+    $context->eval_async('1', sub { push @seen, $_[0]; die "first dies\n" });
+    $context->eval_async('2', sub { push @seen, $_[0] });
+    select undef, undef, undef, 0.5; # both jobs finish before polling
+
+    eval { $context->async_poll };
+    is $@, "first dies\n", 'error of a callback propagates';
+    is_deeply [sort @seen], [1, 2], 'callbacks after a failing one still run';
+}
+
+done_testing;
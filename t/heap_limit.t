@@ -0,0 +1,32 @@
+use Test::More;
+use JavaScript::V8;
+
+my $c = JavaScript::V8::Context->new(max_old_space_size => 64);
+
+$c->eval(q{ var a = []; for (;;) { a.push({ s: "x" + a.length }); } });
+is $@, "Execution terminated: heap limit exceeded\n", 'runaway script terminated';
+
+is $c->eval('a = null; 1 + 1'), 2, 'context is usable afterwards';
+is $@, undef;
+
+my $big = $c->eval(q{ var b = []; for (var i = 0; i < 1000; i++) b.push(i); b.length });
+is $big, 1000, 'small allocations are fine';
+
+{
+    my @warnings;
+    local $SIG{__WARN__} = sub { push @warnings, @_ };
+
+    JavaScript::V8::Context->new(max_old_space_size => 128);
+    like $warnings[0], qr/can't be changed once the heap is set up/, 'warns when sizes of a shared heap are ignored';
+
+    @warnings = ();
+    JavaScript::V8::Context->new(max_old_space_size => 128, own_isolate => 1);
+    is_deeply \@warnings, [], 'sizes apply to an own isolate';
+}
+
+for my $size (2048, -1, 1.5, 'lots') {
+    eval { JavaScript::V8::Context->new(max_old_space_size => $size) };
+    like $@, qr/whole megabytes from 0 to 2047/, "heap size $size rejected";
+}
+
+done_testing;
@@ -1,13 +1,38 @@
 use Test::More;
+use Time::HiRes qw(time sleep);
 use JavaScript::V8;
 
 my $c = JavaScript::V8::Context->new(time_limit => 2);
 $c->eval(q{ for(var i = 1; i; i++) { } });
 ok $@, "timed out with error";
+like $@, qr/terminated/i;
+is $@, "Execution terminated: time limit exceeded\n", 'timeout has a distinct error';
+
+is $c->eval('1 + 1'), 2, 'context is usable after a timeout';
+is $@, undef;
+
+$c->eval('throw "terminated"');
+unlike $@, qr/^Execution terminated:/, 'script errors are not timeouts';
 
 {
-  local $TODO = "return correct error on timeout";
-  like $@, qr/terminated/i;
+    my $c = JavaScript::V8::Context->new(time_limit_ms => 50);
+    my $start = time;
+    $c->eval(q{ for(var i = 1; i; i++) { } });
+    is $@, "Execution terminated: time limit exceeded\n", 'millisecond timeout';
+    cmp_ok time - $start, '<', 1, 'stopped well within a second';
+
+    $c->eval('1') for 1..1000;
+    is $@, undef, 'fast evals are not terminated';
+}
+
+{
+    my $c = JavaScript::V8::Context->new(cpu_time_limit_ms => 100);
+    $c->bind(snooze => sub { sleep 0.3 });
+    is $c->eval('snooze(); 42'), 42, 'blocking in perl does not use the cpu budget';
+    is $@, undef;
+
+    $c->eval(q{ for(var i = 1; i; i++) { } });
+    is $@, "Execution terminated: CPU time limit exceeded\n", 'cpu time limit';
 }
 
 done_testing;
@@ -0,0 +1,51 @@
+#!/usr/bin/perl
+use Test::More;
+use Config;
+use JavaScript::V8;
+use strict;
+use warnings;
+
+my $c1 = JavaScript::V8::Context->new(own_isolate => 1);
+my $c2 = JavaScript::V8::Context->new(own_isolate => 1, time_limit_ms => 100);
+my $shared = JavaScript::V8::Context->new;
+
+is $c1->eval('1 + 2'), 3, 'eval in own isolate';
+is_deeply $c1->eval('({a: [1, 2]})'), { a => [1, 2] }, 'objects are converted';
+
+$c1->bind(add => sub { $_[0] + $_[1] });
+is $c1->eval('add(2, 3)'), 5, 'perl callbacks';
+
+my $double = $c1->eval('(function(x) { return x * 2 })');
+is $double->(21), 42, 'functions from an isolate';
+
+$c2->bind(double => $double);
+is $c2->eval('double(4)'), 8, 'calling into another isolate through perl';
+
+$c1->bind(spin => sub { $c2->eval('for (;;) {}'); $@ });
+like $c1->eval('spin()'), qr/^Execution terminated/, 'nested isolate timed out';
+is $c1->eval('"still running"'), 'still running', 'termination did not leak into the calling isolate';
+is $shared->eval('"fine"'), 'fine', 'default isolate unaffected';
+
+{
+    my $c = JavaScript::V8::Context->new(own_isolate => 1);
+    $double = $c->eval('(function(x) { return x * 2 })');
+}
+ok !eval { $double->(1); 1 }, 'function outlives its isolate';
+like $@, qr/context is no more/;
+
+SKIP: {
+    skip 'no ithreads', 2 unless $Config{useithreads};
+    require threads;
+
+    my @threads = map {
+        threads->create(sub {
+            my $c = JavaScript::V8::Context->new(own_isolate => 1);
+            $c->eval("var s = 0; for (var i = 0; i < 1000000; i++) s += $_; s");
+        })
+    } 1..2;
+
+    is $threads[0]->join, 1000000, 'thread 1';
+    is $threads[1]->join, 2000000, 'thread 2';
+}
+
+done_testing;
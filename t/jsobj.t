@@ -136,4 +136,40 @@ like $@, qr{SomeError.*at counter\.js:\d+}, 'js method error propagates to perl'
     is_deeply [$c->previousValues], [1, 77, 78], 'method in list context';
 }
 
+{
+    my $context = JavaScript::V8::Context->new(enable_blessing => 1);
+
+    $context->eval($COUNTER_SRC);
+
+    my $counters = $context->eval('var a = []; for (var i = 0; i < 100; i++) { a.push(new Counter()); a[i].set(i) } a');
+    is scalar(grep { ref $_ eq ref $counters->[0] } @$counters), 100, 'objects of one class share a package';
+    is $counters->[42]->get, 42, 'methods of shared package';
+
+    my $own = $context->eval('var c = new Counter(); c.__perlPackage = "Other"; c');
+    like ref $own, qr/^Other::N\d+$/, 'object naming its own package';
+    like ref $context->eval('new Counter'), qr/^Counter::N\d+$/, 'prototype package kept';
+
+    my $long = 'Long' . ('::Name' x 40);
+    my $c = $context->eval("function L() {} L.prototype.get = function () { return 'long' }; L.prototype.__perlPackage = '$long'; new L");
+    like ref $c, qr/^\Q$long\E::N\d+$/, 'long package names are not truncated';
+    is $c->get, 'long', 'methods of long package';
+}
+
+{
+    my $context = JavaScript::V8::Context->new(enable_blessing => 1);
+
+    $context->eval($COUNTER_SRC);
+
+    my $package = ref $context->eval('new Counter');
+    require Symbol;
+    Symbol::delete_package($package);
+
+    my $c = $context->eval('var c = new Counter(); c.set(5); c');
+    is ref $c, $package, 'deleted package is made again';
+    is $c->get, 5, 'methods of the package made again';
+
+    $context->eval('Counter.prototype.__perlPackage = "Renamed"');
+    like ref $context->eval('new Counter'), qr/^Renamed::N\d+$/, 'renaming the package on the prototype';
+}
+
 done_testing;
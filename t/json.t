@@ -0,0 +1,39 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use utf8;
+use strict;
+use warnings;
+
+my $context = JavaScript::V8::Context->new();
+
+$context->bind_json(input => '{"items":[1,2,3],"name":"тест","nested":{"ok":true}}');
+is $context->eval('input.items.length'), 3, 'array parsed';
+is $context->eval('input.name'), 'тест', 'UTF-8 string';
+ok $context->eval('input.nested.ok === true'), 'booleans stay booleans';
+
+my $big = '[' . join(',', map { qq{{"id":$_}} } 1..5000) . ']';
+$context->bind_json(big => $big);
+is $context->eval('big[4999].id'), 5000, 'big document';
+
+eval { $context->bind_json(broken => '{"a":') };
+ok $@, 'invalid JSON dies';
+is $context->eval('typeof broken'), 'undefined', 'nothing bound on error';
+
+is $context->eval_json('({ a: [1, "ü"], b: null })'), '{"a":[1,"ü"],"b":null}', 'result as JSON';
+is $@, undef, 'no error';
+is $context->eval_json('input.items.map(function(x) { return x * 2 })'), '[2,4,6]', 'array result';
+is $context->eval_json('"str"'), '"str"', 'string result';
+is $context->eval_json('undefined'), undef, 'undefined has no JSON';
+is $@, undef, 'but is no error';
+
+is $context->eval_json('var c = {}; c.c = c; c'), undef, 'cyclic result';
+ok $@, 'sets $@';
+
+is $context->eval_json('throw "oops"'), undef, 'script error';
+like $@, qr/oops/, 'error message';
+
+$context->eval('JSON.stringify = function() { return "replaced" }');
+is $context->eval_json('[1]'), '[1]', 'not affected by scripts';
+
+done_testing;
@@ -0,0 +1,52 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use utf8;
+use strict;
+use warnings;
+
+my $context = JavaScript::V8::Context->new(lazy_results => 1);
+
+my $big = $context->eval('var big = []; for (var i = 0; i < 100000; i++) big.push({ id: i, tags: ["a", "b"] }); big');
+ok tied(@$big), 'array result is tied';
+is scalar(@$big), 100000, 'length';
+is $big->[12345]{id}, 12345, 'nested element';
+is_deeply $big->[-1]{tags}, ['a', 'b'], 'negative index and nested array';
+is $big->[100000], undef, 'past the end';
+ok exists $big->[0], 'exists';
+is $big->[7], $big->[7], 'converted elements are kept';
+
+my $obj = $context->eval('({ name: "тест", n: 1.5, nested: { ok: true }, f: function() { return 42 } })');
+ok tied(%$obj), 'object result is tied';
+is $obj->{name}, 'тест', 'string value';
+is $obj->{n}, 1.5, 'number value';
+is $obj->{nested}{ok}, 1, 'nested object';
+is $obj->{f}->(), 42, 'functions are functions';
+ok exists $obj->{name}, 'exists';
+ok !exists $obj->{missing}, 'not exists';
+is_deeply [sort keys %$obj], [qw(f n name nested)], 'keys';
+{
+    my %seen;
+    while (my ($k, $v) = each %$obj) { $seen{$k} = 1 }
+    is_deeply [sort keys %seen], [qw(f n name nested)], 'each';
+}
+ok scalar(%$obj), 'hash in scalar context';
+
+is $context->eval('42'), 42, 'primitives are not tied';
+is $context->eval('"str"'), 'str', 'strings are not tied';
+
+eval { $big->[0] = 1 };
+like $@, qr/read-only/, 'writes die';
+
+my $partly = $context->eval('big');
+$context->eval('big[1].id = "changed"');
+is $partly->[1]{id}, 'changed', 'unread elements follow the JavaScript object';
+
+my $eager = JavaScript::V8::Context->new;
+ok !tied(@{ $eager->eval('[1, 2]') }), 'eager by default';
+
+undef $context;
+eval { $partly->[2] };
+like $@, qr/context is no more/, 'reading after the context is gone dies';
+
+done_testing;
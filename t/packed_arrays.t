@@ -0,0 +1,42 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use strict;
+use warnings;
+
+my $context = JavaScript::V8::Context->new(packed_arrays => 1);
+
+my @doubles = map { $_ / 4 } 1..100000;
+$context->bind(doubles => \@doubles);
+ok !$context->eval('Array.isArray(doubles)'), 'doubles are packed';
+is $context->eval('doubles.length'), 100000, 'length';
+is $context->eval('doubles[3]'), 1, 'element';
+is $context->eval('var s = 0; for (var i = 0; i < doubles.length; i++) s += doubles[i]; s'), 100000 * 100001 / 8, 'sum';
+
+my @ints = (1..20, -5);
+$context->bind(ints => \@ints);
+is $context->eval('ints.reduce(function(a, b) { return a + b })'), 205, 'Array.prototype methods';
+is $context->eval('ints[20]'), -5, 'negative int';
+
+is_deeply $context->eval('doubles'), \@doubles, 'doubles come back';
+is_deeply $context->eval('ints'), \@ints, 'ints come back';
+is_deeply $context->eval('ints.map(function(x) { return x * 2 })'), [map { $_ * 2 } @ints], 'map gives a real array';
+is $context->eval('ints[0] = 0.5; ints[1] = -2.25; ints[0] + ints[1]'), -1.75, 'fractions written into integers are kept';
+
+$context->bind(short => [1, 2, 3]);
+ok $context->eval('Array.isArray(short)'), 'short arrays are not packed';
+
+$context->bind(mixed => [(1) x 20, 'a']);
+ok $context->eval('Array.isArray(mixed)'), 'mixed arrays are not packed';
+
+$context->bind(strings => [map { "$_" } 1..20]);
+is $context->eval('typeof strings[0]'), 'string', 'numeric strings stay strings';
+
+my $shared = [1..20];
+$context->bind(twice => [$shared, $shared]);
+ok $context->eval('twice[0] === twice[1]'), 'shared packed array';
+
+ok +JavaScript::V8::Context->new->eval('(function(a) { return Array.isArray(a) })')->([1..20]),
+    'not packed by default';
+
+done_testing;
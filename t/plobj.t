@@ -53,6 +53,12 @@ sub DESTROY {
     my $self = shift;
     ($self->{on_destroy} || sub {})->();
 }
+
+package Counter::Named;
+our @ISA = ('Counter');
+our $not_a_method = 1;
+
+sub name { 'named' }
     
 package main;
 
@@ -140,4 +146,43 @@ $context->set_flags_from_string("--expose-gc");
     is $context->eval('(function (c) { return c.zzz; })')->($c), "value to persist", 'perl functions are converted once';
 }
 
+{
+    my $c = Counter::Named->new;
+    is $context->eval('(function (c) { c.inc(); return c.name() + c.get() })')->($c), 'named2', 'inherited methods';
+    ok $context->eval('(function (c) { return "inc" in c && !("nope" in c) })')->($c), 'in operator';
+    is $context->eval('(function (c) { return typeof c.not_a_method })')->($c), 'undefined', 'variables are not methods';
+    is $context->eval('(function (c) { return typeof c.toString() })')->($c), 'string', 'Object.prototype methods stay';
+}
+
+{
+    my $c = Counter::Named->new;
+    my $name = $context->eval('(function (c) { var s = ""; for (var i = 0; i < 3; i++) s += c.name(); return s })');
+    is $name->($c), 'namednamednamed', 'repeated method calls';
+
+    {
+        no warnings 'redefine';
+        *Counter::Named::name = sub { 'renamed' };
+    }
+    is $name->($c), 'renamedrenamedrenamed', 'redefined method is seen';
+
+    {
+        no warnings 'redefine';
+        *Counter::get = sub { 'parent changed' };
+    }
+    is $context->eval('(function (c) { return c.get() })')->($c), 'parent changed', 'change in parent class is seen';
+
+    eval { $context->eval('(function (c, d) { return c.name.call(d) })')->($c, Counter->new) };
+    like $@, qr/Can't locate object method "name"/, 'method applied to another class';
+}
+
+{
+    my $c = Counter::Named->new;
+    my $has_later = $context->eval('(function (c) { return typeof c.later })');
+    is $has_later->($c), 'undefined', 'method not defined yet';
+
+    *Counter::Named::later = sub { 'defined later' };
+    is $has_later->($c), 'function', 'method defined after first use is seen';
+    is $context->eval('(function (c) { return c.later() })')->($c), 'defined later', 'method defined later is called';
+}
+
 done_testing;
@@ -0,0 +1,40 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use strict;
+use warnings;
+
+{
+    my $context = JavaScript::V8::Context->new(script_cache_size => 2);
+
+    $context->eval('var n = 0');
+    is $context->eval('++n'), $_, "cached script runs again ($_)" for 1..3;
+
+    my $stats = $context->script_cache_stats;
+    is $stats->{hits}, 2, 'hits counted';
+    is $stats->{misses}, 2, 'misses counted';
+    is $stats->{entries}, 2, 'entries';
+    is $stats->{capacity}, 2, 'capacity';
+
+    is $context->eval('n', 'other.js'), 3, 'origin is part of the key';
+    is $context->script_cache_stats->{entries}, 2, 'cache does not grow past its size';
+
+    $context->eval('var n = 0');
+    is $context->script_cache_stats->{misses}, 4, 'lru entry was evicted';
+    is $context->eval('++n'), 1, 'evicted script is recompiled';
+    is $context->script_cache_stats->{misses}, 5;
+
+    $context->eval('function(');
+    like $@, qr/SyntaxError/, 'syntax errors are still reported';
+    $context->eval('function(');
+    like $@, qr/SyntaxError/, 'syntax errors are not cached';
+}
+
+{
+    my $context = JavaScript::V8::Context->new;
+    is $context->eval('1 + 1'), 2;
+    is $context->eval('1 + 1'), 2;
+    is_deeply $context->script_cache_stats, { hits => 0, misses => 0, entries => 0, capacity => 0 }, 'cache is off by default';
+}
+
+done_testing;
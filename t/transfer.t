@@ -0,0 +1,72 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use utf8;
+use strict;
+use warnings;
+
+my $context = JavaScript::V8::Context->new();
+
+my $data = {
+    int     => 42,
+    big     => 2**40,
+    neg     => -7,
+    float   => 1.5,
+    str     => 'тест',
+    latin1  => "caf\x{e9}",
+    undef   => undef,
+    list    => [1, [2, 3], { four => 4 }],
+    code    => sub { 1 },
+};
+$data->{self} = $data;
+
+$context->transfer(data => $data);
+is $context->eval('data.int + 1'), 43, 'int';
+is $context->eval('data.big'), 2**40, 'large integer';
+is $context->eval('data.neg'), -7, 'negative';
+is $context->eval('data.float * 2'), 3, 'double';
+is $context->eval('data.str'), 'тест', 'UTF-8 string';
+is $context->eval('data.latin1.length'), 4, 'Latin-1 string';
+is $context->eval('data.latin1'), "caf\x{e9}", 'Latin-1 roundtrip';
+is $context->eval('typeof data.undef'), 'undefined', 'undef';
+is $context->eval('data.list[1][1] + data.list[2].four'), 7, 'nested';
+is $context->eval('typeof data.code'), 'undefined', 'code is dropped';
+ok $context->eval('data.self === data'), 'cycle';
+
+$context->transfer(n => 5);
+is $context->eval('n'), 5, 'plain scalar';
+
+$context->eval('var out = { a: [1, 2.5, "ü", true, null], o: {}, f: function() {} }; out.o.back = out; out.again = out.a');
+my $out = $context->export('out');
+is_deeply $out->{a}, [1, 2.5, 'ü', 1, undef], 'export values';
+is $out->{f}, undef, 'functions become undef';
+is $out->{o}{back}, $out, 'exported cycle';
+is $out->{again}, $out->{a}, 'shared reference';
+$out->{o}{back} = undef;
+
+is $context->export('nothing_here'), undef, 'missing global';
+
+{
+    require Tie::Hash;
+    tie my %tied, 'Tie::StdHash';
+    %tied = (a => 1, b => 2);
+    $context->transfer(tied => [\%tied, 'after']);
+    is $context->eval('tied[0].a + tied[0].b'), 3, 'tied hash';
+    is $context->eval('tied[1]'), 'after', 'data after a tied hash';
+
+    require Hash::Util;
+    my %restricted = (a => 1, b => 2, c => 3);
+    Hash::Util::lock_keys(%restricted);
+    delete $restricted{b};
+    $context->transfer(restricted => [\%restricted, 'after']);
+    is $context->eval('Object.keys(restricted[0]).sort().join()'), 'a,c', 'restricted hash';
+    is $context->eval('restricted[1]'), 'after', 'data after a restricted hash';
+
+    my $lazy = JavaScript::V8::Context->new(lazy_results => 1);
+    my $proxy = $lazy->eval('({ x: 1, y: [2, 3] })');
+    $context->transfer(proxy => [$proxy, 'after']);
+    is $context->eval('proxy[0].x + proxy[0].y[1]'), 4, 'lazy result proxy';
+    is $context->eval('proxy[1]'), 'after', 'data after a proxy';
+}
+
+done_testing;
@@ -29,4 +29,42 @@ is $context->eval('(function(v) { return v + 2; })')->($val), '32', 'string conv
 is $context->eval('"тест"'), 'тест', 'utf8 ok';
 is $context->eval('(function(v) { return v; })')->('тест'), 'тест';
 
+{
+    my $big = 'x' x 100_000;
+    is $context->eval('(function(v) { return v.length; })')->($big), 100_000, 'big ascii string';
+    is $context->eval('(function(v) { return v; })')->($big), $big, 'big ascii string roundtrip';
+
+    $context->bind(big => $big);
+    substr($big, 0, 1, 'y');
+    is $context->eval('big.charAt(0)'), 'x', 'bound string does not see later perl changes';
+
+    SKIP: {
+        require B;
+        skip 'no copy-on-write strings', 2 unless defined &B::SVf_IsCOW;
+
+        my $shared = 'z' x 100_000;
+        ok !(B::svref_2object(\$shared)->FLAGS & B::SVf_IsCOW()), 'string not shared before binding';
+        $context->bind(shared => $shared);
+        ok B::svref_2object(\$shared)->FLAGS & B::SVf_IsCOW(), 'bound string shares its buffer';
+    }
+
+    my $latin1 = "\xe9" x 100_000;
+    is $context->eval('(function(v) { return v.charCodeAt(0); })')->($latin1), 0xe9, 'big latin-1 string';
+}
+
+{
+    my $ascii = $context->eval('"abc"');
+    ok !utf8::is_utf8($ascii), 'ascii result is not flagged utf8';
+
+    my $wide = $context->eval('"тест"');
+    ok utf8::is_utf8($wide), 'non-ascii result is flagged utf8';
+    is length $wide, 4;
+
+    is $context->eval('""'), '', 'empty string';
+    is $context->eval('"a\\u0000b"'), "a\0b", 'embedded NUL';
+
+    my $page = $context->eval('new Array(100001).join("тест")');
+    is length $page, 400_000, 'big utf8 result';
+}
+
 done_testing;
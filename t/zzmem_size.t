@@ -0,0 +1,30 @@
+#!/usr/bin/perl
+
+use utf8;
+use strict;
+use warnings;
+
+use Test::More skip_all => $^V lt v5.10;
+
+use FindBin;
+my $context = require "$FindBin::Bin/mem.pl";
+
+package Big;
+
+our $destroyed = 0;
+
+sub new {
+    my ($class) = @_;
+    bless { data => 'x' x 1_000_000, list => [ (1) x 1000 ] }, $class
+}
+
+sub DESTROY { $destroyed++ }
+
+package main;
+
+my $touch = $context->eval('(function(big) { return typeof big })');
+$touch->(Big->new) for 1..400;
+
+ok $Big::destroyed > 0, 'wrappers of large objects are collected without idle notifications';
+
+done_testing;